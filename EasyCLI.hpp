@@ -11,14 +11,66 @@
  */
 
 #pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bitset>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <exception>
 #include <functional>
+#include <initializer_list>
+#include <iomanip>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <new>
 #include <sstream>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
 #include <unordered_map>
+#include <utility>
 #include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define EASYCLI_POSIX 1
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+#else
+#include <fstream>
+#include <iterator>
+#endif
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#define EASYCLI_COROUTINES 1
+#include <coroutine>
+#include <optional>
+#include <queue>
+#endif
+
+#if defined(__GNUC__) && defined(__SSE2__)
+#define EASYCLI_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
 #define BINDFN(fn) static_cast<CommandOutput (*)(const CommandArguments &)>(fn)
 #define COMMAND_FUNCTION(name) CommandOutput name(const CommandArguments &args)
+#define STREAMING_COMMAND_FUNCTION(name) CommandOutput name(const CommandArguments &args, OutputSink &out)
 
 /**
  * @brief A struct that contains the output of a command
@@ -31,301 +83,5125 @@ struct CommandOutput {
     bool success;
 };
 
+namespace detail {
+/**
+ * @brief 64-bit FNV-1a hash of a name, usable at compile time
+ */
+constexpr std::uint64_t HashName(std::string_view name) {
+    std::uint64_t hash = 14695981039346656037ull;
+    for (char c : name) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+    }
+    return hash;
+}
+
+/**
+ * @brief An open-addressing index over the entries of an option map, kept at most half full
+ * @remark It only stores entry numbers and hashes. The map gives it a way to read the key of an entry, so the same index
+ *         works for keys owned by the map and for views into the parsed input
+ */
+class FlatIndex {
+  public:
+    static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+    template <typename KeyAt> std::size_t Find(std::string_view key, std::uint64_t hash, KeyAt key_at) const {
+        if (slots.empty()) {
+            return npos;
+        }
+        const std::size_t mask = slots.size() - 1;
+        for (std::size_t slot = hash & mask; slots[slot] != 0; slot = (slot + 1) & mask) {
+            const std::size_t entry = slots[slot] - 1;
+            if (hashes[entry] == hash && key_at(entry) == key) {
+                return entry;
+            }
+        }
+        return npos;
+    }
+
+    /**
+     * @brief Indexes a new entry, which must be numbered size()
+     */
+    void Insert(std::uint64_t hash) {
+        hashes.push_back(hash);
+        if (hashes.size() * 2 > slots.size()) {
+            Rehash(std::max<std::size_t>(16, slots.size() * 2));
+        } else {
+            Place(hashes.size() - 1);
+        }
+    }
+
+    void clear() {
+        std::fill(slots.begin(), slots.end(), 0);
+        hashes.clear();
+    }
+
+    std::size_t size() const {
+        return hashes.size();
+    }
+
+  private:
+    void Place(std::size_t entry) {
+        const std::size_t mask = slots.size() - 1;
+        std::size_t slot = hashes[entry] & mask;
+        while (slots[slot] != 0) {
+            slot = (slot + 1) & mask;
+        }
+        slots[slot] = static_cast<std::uint32_t>(entry + 1);
+    }
+
+    void Rehash(std::size_t capacity) {
+        slots.assign(capacity, 0);
+        for (std::size_t entry = 0; entry < hashes.size(); entry++) {
+            Place(entry);
+        }
+    }
+
+    // Entry number + 1 in each slot, 0 for an empty slot
+    std::vector<std::uint32_t> slots;
+    std::vector<std::uint64_t> hashes;
+};
+} // namespace detail
+
+/**
+ * @brief The `key=value` options of a command, with O(1) lookup by key
+ * @remark Keys and values are packed into one string owned by the map, so parsing doesn't allocate per option
+ *         and copying the map is safe. A key given twice keeps its last value
+ */
+class OptionMap {
+  public:
+    /**
+     * @brief Returns the value of an option, or an empty view if there is no such option
+     */
+    std::string_view operator[](std::string_view key) const {
+        return get(key);
+    }
+
+    /**
+     * @brief Returns the value of an option, or fallback if there is no such option
+     */
+    std::string_view get(std::string_view key, std::string_view fallback = std::string_view()) const {
+        const std::size_t entry = Find(key);
+        return entry == detail::FlatIndex::npos ? fallback : Value(entry);
+    }
+
+    bool contains(std::string_view key) const {
+        return Find(key) != detail::FlatIndex::npos;
+    }
+
+    /**
+     * @brief Adds an option, replacing the value of an existing one
+     */
+    void insert(std::string_view key, std::string_view value) {
+        const std::uint64_t hash = detail::HashName(key);
+        const std::size_t existing = index.Find(key, hash, [this](std::size_t entry) { return Key(entry); });
+        const std::size_t value_offset = storage.size();
+        storage += value;
+        if (existing != detail::FlatIndex::npos) {
+            entries[existing].value_offset = value_offset;
+            entries[existing].value_length = value.size();
+            return;
+        }
+        const std::size_t key_offset = storage.size();
+        storage += key;
+        entries.push_back(Entry{key_offset, key.size(), value_offset, value.size()});
+        index.Insert(hash);
+    }
+
+    /**
+     * @brief Returns the key and value of the i-th option, in the order they were given
+     */
+    std::pair<std::string_view, std::string_view> at(std::size_t i) const {
+        return {Key(i), Value(i)};
+    }
+
+    std::size_t size() const {
+        return entries.size();
+    }
+
+    bool empty() const {
+        return entries.empty();
+    }
+
+    /**
+     * @brief Removes every option while keeping the allocated memory
+     */
+    void clear() {
+        storage.clear();
+        entries.clear();
+        index.clear();
+    }
+
+  private:
+    struct Entry {
+        std::size_t key_offset;
+        std::size_t key_length;
+        std::size_t value_offset;
+        std::size_t value_length;
+    };
+
+    std::size_t Find(std::string_view key) const {
+        return index.Find(key, detail::HashName(key), [this](std::size_t entry) { return Key(entry); });
+    }
+
+    std::string_view Key(std::size_t entry) const {
+        return std::string_view(storage).substr(entries[entry].key_offset, entries[entry].key_length);
+    }
+
+    std::string_view Value(std::size_t entry) const {
+        return std::string_view(storage).substr(entries[entry].value_offset, entries[entry].value_length);
+    }
+
+    std::string storage;
+    std::vector<Entry> entries;
+    detail::FlatIndex index;
+};
+
+/**
+ * @brief The `key=value` options of a CommandArgumentsView, as views into the parsed input
+ * @remark Same interface as OptionMap, without copying keys or values
+ */
+class OptionMapView {
+  public:
+    std::string_view operator[](std::string_view key) const {
+        return get(key);
+    }
+
+    std::string_view get(std::string_view key, std::string_view fallback = std::string_view()) const {
+        const std::size_t entry = Find(key);
+        return entry == detail::FlatIndex::npos ? fallback : entries[entry].second;
+    }
+
+    bool contains(std::string_view key) const {
+        return Find(key) != detail::FlatIndex::npos;
+    }
+
+    void insert(std::string_view key, std::string_view value) {
+        const std::uint64_t hash = detail::HashName(key);
+        const std::size_t existing = index.Find(key, hash, [this](std::size_t entry) { return entries[entry].first; });
+        if (existing != detail::FlatIndex::npos) {
+            entries[existing].second = value;
+            return;
+        }
+        entries.emplace_back(key, value);
+        index.Insert(hash);
+    }
+
+    std::pair<std::string_view, std::string_view> at(std::size_t i) const {
+        return entries[i];
+    }
+
+    std::size_t size() const {
+        return entries.size();
+    }
+
+    bool empty() const {
+        return entries.empty();
+    }
+
+    void clear() {
+        entries.clear();
+        index.clear();
+    }
+
+  private:
+    std::size_t Find(std::string_view key) const {
+        return index.Find(key, detail::HashName(key), [this](std::size_t entry) { return entries[entry].first; });
+    }
+
+    std::vector<std::pair<std::string_view, std::string_view>> entries;
+    detail::FlatIndex index;
+};
+
+/**
+ * @brief The flags a command declares when it is registered, numbered in the order they were declared
+ * @remark Dispatch looks every parsed flag up here once and sets its bit in CommandArguments::flag_bits,
+ *         so the command can check a declared flag with a single bit test. Only the first kMaxFlags flags get a bit
+ */
+class FlagSet {
+  public:
+    static constexpr std::size_t npos = detail::FlatIndex::npos;
+    static constexpr std::size_t kMaxFlags = 64;
+
+    FlagSet(std::initializer_list<std::string_view> flags) {
+        for (std::string_view flag : flags) {
+            Add(flag);
+        }
+    }
+
+    explicit FlagSet(const std::vector<std::string> &flags) {
+        for (const std::string &flag : flags) {
+            Add(flag);
+        }
+    }
+
+    /**
+     * @brief Returns the index of a flag (without its leading '-'), or npos if it wasn't declared
+     */
+    std::size_t IndexOf(std::string_view flag) const {
+        return index.Find(flag, detail::HashName(flag), [this](std::size_t entry) { return std::string_view(names[entry]); });
+    }
+
+    const std::string &operator[](std::size_t i) const {
+        return names[i];
+    }
+
+    std::size_t size() const {
+        return names.size();
+    }
+
+  private:
+    void Add(std::string_view flag) {
+        if (IndexOf(flag) != npos) {
+            throw std::invalid_argument("Duplicate flag: \"" + std::string(flag) + "\"");
+        }
+        names.emplace_back(flag);
+        index.Insert(detail::HashName(flag));
+    }
+
+    std::vector<std::string> names;
+    detail::FlatIndex index;
+};
+
+/**
+ * @brief The output of the previous command in a pipeline, read by the next command in chunks
+ */
+class InputSource {
+  public:
+    virtual ~InputSource() = default;
+
+    /**
+     * @brief Waits for the next chunk of input
+     *
+     * @param chunk Set to a view of the next chunk, valid until the next call. Chunks don't follow line boundaries
+     * @return true if a chunk was read
+     * @return false once the previous command has returned and all its output was read
+     */
+    virtual bool Read(std::string_view &chunk) = 0;
+};
+
+/**
+ * @brief Splits the chunks of an InputSource into lines, for commands that filter their input line by line
+ * @remark Lines are views into the chunks, without their '\n'. Only a line split across two chunks is copied
+ */
+class LineReader {
+  public:
+    explicit LineReader(InputSource &source) : source(source) {
+    }
+
+    /**
+     * @brief Reads the next line
+     *
+     * @param line Set to a view of the next line, valid until the next call. The last line may have no '\n'
+     * @return true if a line was read
+     * @return false at the end of the input
+     */
+    bool Next(std::string_view &line) {
+        if (carry_returned) {
+            carry.clear();
+            carry_returned = false;
+        }
+        for (;;) {
+            const std::size_t newline = rest.find('\n');
+            if (newline != std::string_view::npos) {
+                if (carry.empty()) {
+                    line = rest.substr(0, newline);
+                } else {
+                    carry.append(rest.data(), newline);
+                    line = carry;
+                    carry_returned = true;
+                }
+                rest.remove_prefix(newline + 1);
+                return true;
+            }
+            // The chunk is only valid until the next read, so the start of a line split across chunks is kept
+            carry.append(rest.data(), rest.size());
+            rest = std::string_view();
+            if (!source.Read(rest)) {
+                if (carry.empty()) {
+                    return false;
+                }
+                line = carry;
+                carry_returned = true;
+                return true;
+            }
+        }
+    }
+
+  private:
+    InputSource &source;
+    std::string_view rest;
+    std::string carry;
+    bool carry_returned = false;
+};
+
+/**
+ * @brief Lets a caller tell commands to stop. Copies share the same state, so one copy can be cancelled from another thread
+ *        while a command checks another
+ */
+class CancellationToken {
+  public:
+    /**
+     * @brief Makes a token that is never cancelled, and costs nothing to check
+     */
+    CancellationToken() noexcept {
+    }
+
+    /**
+     * @brief Makes a token that can be cancelled
+     */
+    static CancellationToken Create() {
+        CancellationToken token;
+        token.state = std::make_shared<std::atomic<bool>>(false);
+        return token;
+    }
+
+    /**
+     * @brief Cancels this token and its copies. Does nothing on a token made by the default constructor
+     */
+    void Cancel() const noexcept {
+        if (state) {
+            state->store(true, std::memory_order_release);
+        }
+    }
+
+    bool IsCancelled() const noexcept {
+        return state && state->load(std::memory_order_acquire);
+    }
+
+    /**
+     * @brief Returns false for a token made by the default constructor, which can never be cancelled
+     */
+    bool CanBeCancelled() const noexcept {
+        return state != nullptr;
+    }
+
+  private:
+    std::shared_ptr<std::atomic<bool>> state;
+};
+
+/**
+ * @brief  A struct that contains the parsed arguments of a command
+ * @remark You, the user, needs to use this when you write your own commands
+ *         as const CommandArguments &args is passed to your command function
+ */
+struct CommandArguments {
+    std::string command;
+    std::vector<std::string> arguments;
+    std::vector<std::string> flags;
+    // The `key=value` and `-flag=value` tokens, by key. `options["bits"]` is "64" for `my_command bits=64`
+    OptionMap options;
+    // Bit i is set if the i-th flag the command declared at registration was given. Undeclared flags are only in `flags`
+    std::bitset<FlagSet::kMaxFlags> flag_bits;
+    // The flags the command declared at registration, or nullptr. Owned by the registry and only valid during the call
+    const FlagSet *known_flags = nullptr;
+    // When the command should have returned, e.g. with ExecuteWithTimeout. time_point::max() if it has no deadline
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+    // Cancelled when the caller no longer wants the output
+    CancellationToken cancellation;
+    // The output of the previous command when this one runs in a pipeline, or nullptr
+    InputSource *input = nullptr;
+
+    /**
+     * @brief Returns true if the command should return now, because it was cancelled or its deadline has passed
+     *
+     * @remark A command that can run for long should check this regularly: its output is replaced with an error anyway.
+     *         Only reads the clock if the command has a deadline
+     */
+    bool stop_requested() const {
+        return cancellation.IsCancelled() || (deadline != std::chrono::steady_clock::time_point::max() && std::chrono::steady_clock::now() >= deadline);
+    }
+
+    /**
+     * @brief Returns true if the flags vector contains the specified flag
+     *
+     * @param flag The flag to check for
+     * @return true if the flags vector contains the specified flag
+     * @return false if the flags vector does not contain the specified flag
+     * @remark This is a convenience function that is equivalent to `std::find(arguments.begin(), arguments.end(), argument) != arguments.end();`
+     * @remark The time complexity of this function is O(n), where n is the number of flags, or O(1) if the command declared the flag
+     */
+    bool flags_contains(const std::string &flag) const {
+        if (known_flags != nullptr) {
+            const std::size_t index = known_flags->IndexOf(flag);
+            if (index < FlagSet::kMaxFlags) {
+                return flag_bits.test(index);
+            }
+        }
+        return std::find(flags.begin(), flags.end(), flag) != flags.end();
+    }
+
+    /**
+     * @brief Returns true if the index-th flag the command declared at registration was given
+     *
+     * @remark This is a single bit test. Indexes past the last declared flag return false
+     */
+    bool flags_contains(std::size_t index) const {
+        return index < FlagSet::kMaxFlags && flag_bits.test(index);
+    }
+
+    /**
+     * @brief Returns true if the arguments vector contains the specified flag
+     *
+     * @param flag The flag to check for
+     * @return true if the arguments vector contains the specified flag
+     * @return false if the arguments vector does not contain the specified flag
+     * @remark This is a convenience function that is equivalent to `std::find(arguments.begin(), arguments.end(), argument) != arguments.end();`
+     * @remark The time complexity of this function is O(n), where n is the number of arguments
+     */
+    bool arguments_contains(const std::string &argument) const {
+        return std::find(arguments.begin(), arguments.end(), argument) != arguments.end();
+    }
+};
+
+namespace detail {
+/**
+ * @brief Returns true if c is a whitespace character, matching what `operator>>` skips in the "C" locale
+ */
+inline bool IsSpace(char c) {
+    return c == ' ' || static_cast<unsigned char>(c - '\t') < 5;
+}
+
+/**
+ * @brief The signature of the token boundary scanners below
+ *
+ * @param data The buffer to scan
+ * @param pos The index to start scanning from
+ * @param size The size of the buffer
+ * @param want_space If true, look for the next whitespace byte, else for the next non-whitespace byte
+ * @return The index of the first matching byte at or after pos, or size if there is none
+ */
+using ScanFunction = std::size_t (*)(const char *data, std::size_t pos, std::size_t size, bool want_space);
+
+/**
+ * @brief Byte-at-a-time scanner, used on every platform for the tail of the buffer and when no SIMD is available
+ */
+inline std::size_t ScanScalar(const char *data, std::size_t pos, std::size_t size, bool want_space) {
+    while (pos < size && IsSpace(data[pos]) != want_space) {
+        pos++;
+    }
+    return pos;
+}
+
+#ifdef EASYCLI_SIMD_X86
+/**
+ * @brief Scans 16 bytes at a time with SSE2, which every x86-64 CPU has
+ */
+inline std::size_t ScanSse2(const char *data, std::size_t pos, std::size_t size, bool want_space) {
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i four = _mm_set1_epi8(4);
+    const unsigned flip = want_space ? 0u : 0xFFFFu;
+    while (pos + 16 <= size) {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + pos));
+        // '\t'..'\r' are contiguous, so (byte - '\t') <= 4 as an unsigned byte covers all of them
+        const __m128i offset = _mm_sub_epi8(bytes, tab);
+        const __m128i control = _mm_cmpeq_epi8(_mm_min_epu8(offset, four), offset);
+        const __m128i whitespace = _mm_or_si128(control, _mm_cmpeq_epi8(bytes, space));
+        const unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(whitespace)) ^ flip;
+        if (mask != 0) {
+            return pos + static_cast<std::size_t>(__builtin_ctz(mask));
+        }
+        pos += 16;
+    }
+    return ScanScalar(data, pos, size, want_space);
+}
+
+/**
+ * @brief Scans 32 bytes at a time with AVX2. Only called when the CPU reports AVX2 support at runtime
+ */
+__attribute__((target("avx2"))) inline std::size_t ScanAvx2(const char *data, std::size_t pos, std::size_t size, bool want_space) {
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i four = _mm256_set1_epi8(4);
+    const unsigned flip = want_space ? 0u : 0xFFFFFFFFu;
+    while (pos + 32 <= size) {
+        const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + pos));
+        const __m256i offset = _mm256_sub_epi8(bytes, tab);
+        const __m256i control = _mm256_cmpeq_epi8(_mm256_min_epu8(offset, four), offset);
+        const __m256i whitespace = _mm256_or_si256(control, _mm256_cmpeq_epi8(bytes, space));
+        const unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(whitespace)) ^ flip;
+        if (mask != 0) {
+            return pos + static_cast<std::size_t>(__builtin_ctz(mask));
+        }
+        pos += 32;
+    }
+    return ScanSse2(data, pos, size, want_space);
+}
+#endif
+
+/**
+ * @brief Returns the fastest scanner supported by the running CPU. The check is only done once
+ */
+inline ScanFunction GetScanFunction() {
+#ifdef EASYCLI_SIMD_X86
+    static const ScanFunction scan = __builtin_cpu_supports("avx2") ? ScanAvx2 : ScanSse2;
+    return scan;
+#else
+    return ScanScalar;
+#endif
+}
+} // namespace detail
+
+/**
+ * @brief Splits a string into whitespace-separated tokens without copying them
+ * @remark The tokens are views into the input, so the input must outlive them
+ * @remark This uses Bash-like splitting, so "echo hello world" and "echo     hello     world" give the same tokens
+ * @remark On x86 the token boundaries are found 16 or 32 bytes at a time with SSE2 or AVX2, picked at runtime
+ */
+class Tokenizer {
+  public:
+    explicit Tokenizer(std::string_view input) : input(input) {
+    }
+
+    /**
+     * @brief Reads the next token
+     *
+     * @param token Set to a view of the next token if there is one
+     * @return true if a token was read
+     * @return false if the end of the input was reached
+     */
+    bool Next(std::string_view &token) {
+        const char *data = input.data();
+        const std::size_t size = input.size();
+        pos = scan(data, pos, size, false);
+        if (pos == size) {
+            return false;
+        }
+        const std::size_t start = pos;
+        pos = scan(data, pos, size, true);
+        token = input.substr(start, pos - start);
+        return true;
+    }
+
+  private:
+    std::string_view input;
+    std::size_t pos = 0;
+    detail::ScanFunction scan = detail::GetScanFunction();
+};
+
+/**
+ * @brief A struct that contains the parsed arguments of a command, as views into the parsed input
+ * @remark This is the zero-copy counterpart of CommandArguments. The views point into the string given to ParseArgsView,
+ *         so that string must outlive this struct
+ */
+struct CommandArgumentsView {
+    std::string_view command;
+    std::vector<std::string_view> arguments;
+    std::vector<std::string_view> flags;
+    OptionMapView options;
+
+    /**
+     * @brief Returns true if the flags vector contains the specified flag
+     * @remark The time complexity of this function is O(n), where n is the number of flags
+     */
+    bool flags_contains(std::string_view flag) const {
+        return std::find(flags.begin(), flags.end(), flag) != flags.end();
+    }
+
+    /**
+     * @brief Returns true if the arguments vector contains the specified argument
+     * @remark The time complexity of this function is O(n), where n is the number of arguments
+     */
+    bool arguments_contains(std::string_view argument) const {
+        return std::find(arguments.begin(), arguments.end(), argument) != arguments.end();
+    }
+
+    /**
+     * @brief Clears the struct while keeping the capacity of its vectors, so it can be reused without allocating
+     */
+    void clear() {
+        command = std::string_view();
+        arguments.clear();
+        flags.clear();
+        options.clear();
+    }
+
+    /**
+     * @brief Copies the views into an owning CommandArguments struct
+     */
+    CommandArguments ToCommandArguments() const {
+        CommandArguments args;
+        args.command = std::string(command);
+        args.arguments.assign(arguments.begin(), arguments.end());
+        args.flags.assign(flags.begin(), flags.end());
+        for (std::size_t i = 0; i < options.size(); i++) {
+            args.options.insert(options.at(i).first, options.at(i).second);
+        }
+        return args;
+    }
+};
+
+namespace detail {
+/**
+ * @brief Sorts a token that follows the command into the arguments, flags or options of args
+ *        - `-name` is a flag
+ *        - `-name=value` is a flag that also sets the option name to value
+ *        - `key=value` sets the option key to value
+ *        - anything else, including `=value`, is an argument
+ */
+template <typename Arguments> void AddToken(Arguments &args, std::string_view token) {
+    const std::size_t equals = token.find('=');
+    if (!token.empty() && token[0] == '-') {
+        // Token is a flag. Remove '-' and store the flag
+        std::string_view flag = token.substr(1);
+        if (equals != std::string_view::npos) {
+            flag = token.substr(1, equals - 1);
+            args.options.insert(flag, token.substr(equals + 1));
+        }
+        args.flags.emplace_back(flag);
+    } else if (equals != std::string_view::npos && equals > 0) {
+        // Token is an option
+        args.options.insert(token.substr(0, equals), token.substr(equals + 1));
+    } else {
+        // Token is an argument
+        args.arguments.emplace_back(token);
+    }
+}
+} // namespace detail
+
+/**
+ * @brief Parses a string into a CommandArgumentsView struct without copying any token
+ *
+ * @remark The vectors of args are cleared but keep their capacity, so reusing the same struct across calls
+ *         makes parsing allocation-free once it has seen an input with as many tokens
+ * @param input The string to parse. It must outlive args
+ * @param args The struct to fill with views into input
+ */
+inline void ParseArgsView(std::string_view input, CommandArgumentsView &args) {
+    args.clear();
+    Tokenizer tokenizer(input);
+    std::string_view token;
+
+    // Extract the command
+    if (!tokenizer.Next(token)) {
+        return;
+    }
+    args.command = token;
+
+    // Extract arguments, flags and options
+    while (tokenizer.Next(token)) {
+        detail::AddToken(args, token);
+    }
+}
+
+/**
+ * @brief Parses a string into a CommandArgumentsView struct without copying any token
+ *
+ * @param input The string to parse. It must outlive the returned struct
+ * @return CommandArgumentsView The parsed struct, holding views into input
+ */
+inline CommandArgumentsView ParseArgsView(std::string_view input) {
+    CommandArgumentsView args;
+    ParseArgsView(input, args);
+    return args;
+}
+
+/**
+ * @brief Classifies the entries of argv into a CommandArgumentsView struct without joining or copying them
+ *        For `./app echo "hello world" -oneline` the struct would look like this:
+ *        {
+ *            command: "echo",
+ *            arguments: ["hello world"],
+ *            flags: ["oneline"]
+ *        }
+ *
+ * @remark Unlike ParseArgs, each argv entry is one token, so arguments that contain spaces are kept whole
+ * @param argc The argc from main()
+ * @param argv The argv from main(). argv[0] (the program name) is skipped
+ * @param args The struct to fill with views into the argv strings
+ */
+inline void ParseArgv(int argc, char **argv, CommandArgumentsView &args) {
+    args.clear();
+    if (argc < 2) {
+        return;
+    }
+    args.command = argv[1];
+    for (int i = 2; i < argc; i++) {
+        detail::AddToken(args, argv[i]);
+    }
+}
+
+namespace detail {
+/**
+ * @brief Appends to a vector of strings by assigning over the strings already in it, so their buffers are reused
+ * @remark With a spare pool, strings left over from a longer previous parse are kept there instead of being freed
+ */
+struct ReusedStrings {
+    std::vector<std::string> &strings;
+    std::vector<std::string> *spare;
+    std::size_t used = 0;
+
+    void emplace_back(std::string_view value) {
+        if (used == strings.size()) {
+            if (spare != nullptr && !spare->empty()) {
+                strings.push_back(std::move(spare->back()));
+                spare->pop_back();
+            } else {
+                strings.emplace_back();
+            }
+        }
+        strings[used++].assign(value.data(), value.size());
+    }
+
+    void Finish() {
+        while (strings.size() > used) {
+            if (spare != nullptr) {
+                spare->push_back(std::move(strings.back()));
+            }
+            strings.pop_back();
+        }
+    }
+};
+
+// What AddToken fills when parsing into an existing CommandArguments
+struct ReusedArguments {
+    ReusedStrings arguments;
+    ReusedStrings flags;
+    OptionMap &options;
+};
+
+// Hands out the entries of argv one at a time, like Tokenizer does for the tokens of a string
+struct ArgvTokens {
+    int argc;
+    char **argv;
+    int next;
+
+    bool Next(std::string_view &token) {
+        if (next >= argc) {
+            return false;
+        }
+        token = argv[next++];
+        return true;
+    }
+};
+
+// Sets args.command to the next token, or clears it if there is none
+template <typename Tokens> void ParseCommandReusing(Tokens &tokens, CommandArguments &args) {
+    std::string_view token;
+    if (!tokens.Next(token)) {
+        token = std::string_view();
+    }
+    args.command.assign(token.data(), token.size());
+}
+
+// Parses the tokens left into the arguments, flags and options of args
+template <typename Tokens> void ParseRestReusing(Tokens &tokens, CommandArguments &args, std::vector<std::string> *spare) {
+    args.options.clear();
+    args.flag_bits.reset();
+    args.known_flags = nullptr;
+    args.deadline = std::chrono::steady_clock::time_point::max();
+    args.cancellation = CancellationToken();
+    args.input = nullptr;
+    ReusedArguments reused{{args.arguments, spare}, {args.flags, spare}, args.options};
+    std::string_view token;
+    while (tokens.Next(token)) {
+        AddToken(reused, token);
+    }
+    reused.arguments.Finish();
+    reused.flags.Finish();
+}
+
+inline void ParseArgsReusing(std::string_view input, CommandArguments &args, std::vector<std::string> *spare) {
+    Tokenizer tokenizer(input);
+    ParseCommandReusing(tokenizer, args);
+    ParseRestReusing(tokenizer, args, spare);
+}
+} // namespace detail
+
+/**
+ * @brief Parses a string into an existing CommandArguments struct, reusing its memory
+ *
+ * @remark The command, argument and flag strings are assigned over the previous ones and the vectors keep their capacity,
+ *         so parsing into the same struct again is allocation-free once it has seen tokens as long and as many
+ * @param input The string to parse
+ * @param args The struct to fill. Everything it held before is replaced
+ */
+inline void ParseArgs(std::string_view input, CommandArguments &args) {
+    detail::ParseArgsReusing(input, args, nullptr);
+}
+
+/**
+ * @brief Parses a string into a CommandArguments struct
+ *        For an input value of "echo hello world -oneline sep=,"
+ *        The CommandArguments struct would look like this:
+ *        {
+ *            command: "echo",
+ *            arguments: ["hello", "world"],
+ *            flags: ["oneline"],
+ *            options: {sep: ","}
+ *        }
+ *
+ * @remark You can use this directly, but it's simpler to use the variations of Execute{...} instead
+ * @remark This uses Bash-like parsing, so "echo hello world" and "echo     hello     world" are equivalent
+ * @param input The string to parse into a CommandArguments struct
+ * @return CommandArguments The parsed CommandArguments struct
+ */
+inline CommandArguments ParseArgs(const std::string &input) {
+    CommandArguments args;
+    ParseArgs(input, args);
+    return args;
+}
+
+namespace detail {
+/**
+ * @brief Splits a pipeline like "a x | b y" at each '|', into views of the input. Input without a '|' is a single stage
+ */
+inline std::vector<std::string_view> SplitPipeline(std::string_view input) {
+    std::vector<std::string_view> stages;
+    for (;;) {
+        const std::size_t bar = input.find('|');
+        stages.push_back(input.substr(0, bar));
+        if (bar == std::string_view::npos) {
+            return stages;
+        }
+        input.remove_prefix(bar + 1);
+    }
+}
+} // namespace detail
+
+/**
+ * @brief Parses a pipeline, like "generate 100 | filter x=3 | count", into the arguments of each of its commands
+ *
+ * @remark Every '|' separates two commands, whether or not it is surrounded by spaces. Each command is parsed like ParseArgs does
+ * @param input The string to parse
+ * @return std::vector<CommandArguments> The arguments of each command, in order
+ */
+inline std::vector<CommandArguments> ParsePipeline(const std::string &input) {
+    std::vector<CommandArguments> stages;
+    for (std::string_view stage : detail::SplitPipeline(input)) {
+        stages.emplace_back();
+        ParseArgs(stage, stages.back());
+    }
+    return stages;
+}
+
+namespace detail {
+/**
+ * @brief Lends the calling thread a CommandArguments to parse into, reused by every Execute call on that thread
+ * @remark Once the thread has parsed its usual inputs, parsing makes no allocation. There is one struct per nesting level,
+ *         so a command that calls Execute itself doesn't overwrite the arguments it was given. The memory is kept until the thread exits
+ */
+class ArgumentsLease {
+  public:
+    ArgumentsLease() {
+        Arena &arena = ThreadArena();
+        if (arena.depth == arena.levels.size()) {
+            arena.levels.push_back(std::make_unique<Level>());
+        }
+        level = arena.levels[arena.depth++].get();
+    }
+
+    ~ArgumentsLease() {
+        ThreadArena().depth--;
+    }
+
+    ArgumentsLease(const ArgumentsLease &) = delete;
+    ArgumentsLease &operator=(const ArgumentsLease &) = delete;
+
+    /**
+     * @brief Parses input into the lent CommandArguments, keeping the strings it doesn't need for the next parse
+     */
+    CommandArguments &Parse(std::string_view input) const {
+        ParseArgsReusing(input, level->args, &level->spare);
+        return level->args;
+    }
+
+    /**
+     * @brief Parses the next token as the command name of the lent CommandArguments, leaving the tokens after it for ParseRest
+     */
+    template <typename Tokens> CommandArguments &ParseCommand(Tokens &tokens) const {
+        ParseCommandReusing(tokens, level->args);
+        return level->args;
+    }
+
+    /**
+     * @brief Parses the tokens left into the arguments, flags and options of the lent CommandArguments
+     */
+    template <typename Tokens> void ParseRest(Tokens &tokens) const {
+        ParseRestReusing(tokens, level->args, &level->spare);
+    }
+
+  private:
+    struct Level {
+        CommandArguments args;
+        std::vector<std::string> spare;
+    };
+
+    struct Arena {
+        std::vector<std::unique_ptr<Level>> levels;
+        std::size_t depth = 0;
+    };
+
+    static Arena &ThreadArena() {
+        thread_local Arena arena;
+        return arena;
+    }
+
+    Level *level;
+};
+} // namespace detail
+
+/**
+ * @brief The hash used by CommandMap. It is transparent, so the map can be searched with a std::string_view
+ *        without building a temporary std::string for the key
+ */
+struct CommandNameHash {
+    using is_transparent = void;
+
+    std::size_t operator()(std::string_view name) const {
+        return std::hash<std::string_view>{}(name);
+    }
+};
+
+namespace detail {
+/**
+ * @brief Builds the error output returned for a command that isn't registered
+ */
+inline CommandOutput UnknownCommand(std::string_view name) {
+    std::string error = "Unknown command: \"";
+    error += name;
+    error += '"';
+    return CommandOutput{std::move(error), false};
+}
+
+inline bool PastDeadline(const CommandArguments &args) {
+    return args.deadline != std::chrono::steady_clock::time_point::max() && std::chrono::steady_clock::now() >= args.deadline;
+}
+
+/**
+ * @brief Returns the deadline timeout from now. nanoseconds::max(), or a timeout too long to represent, means no deadline
+ */
+inline std::chrono::steady_clock::time_point DeadlineAfter(std::chrono::nanoseconds timeout) {
+    const auto never = std::chrono::steady_clock::time_point::max();
+    if (timeout == std::chrono::nanoseconds::max()) {
+        return never;
+    }
+    const auto now = std::chrono::steady_clock::now();
+    return timeout >= never - now ? never : now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(timeout);
+}
+
+/**
+ * @brief Replaces the output of a command that was cancelled, or that returned after its deadline, with an error output
+ */
+inline CommandOutput CheckInterrupted(CommandOutput out, const CommandArguments &args) {
+    if (args.cancellation.IsCancelled()) {
+        return CommandOutput{"Command \"" + args.command + "\" was cancelled", false};
+    }
+    if (PastDeadline(args)) {
+        return CommandOutput{"Command \"" + args.command + "\" timed out", false};
+    }
+    return out;
+}
+
+/**
+ * @brief Builds the error output for a group of subcommands given without a subcommand
+ */
+inline CommandOutput MissingSubcommand(std::string_view group, const std::vector<std::string> &subcommands) {
+    std::string error = "Missing subcommand after \"";
+    error += group;
+    error += '"';
+    for (std::size_t i = 0; i < subcommands.size(); i++) {
+        error += i == 0 ? ". Available subcommands: " : ", ";
+        error += subcommands[i];
+    }
+    return CommandOutput{std::move(error), false};
+}
+} // namespace detail
+
+/**
+ * @brief Where a streaming command writes its output, piece by piece
+ * @remark Implement Write to send output somewhere new. StreamOutputSink, StringOutputSink and FdOutputSink cover the common cases
+ */
+class OutputSink {
+  public:
+    virtual ~OutputSink() = default;
+
+    /**
+     * @brief Writes a piece of output
+     */
+    virtual void Write(std::string_view data) = 0;
+
+    /**
+     * @brief Passes on anything the sink buffered. Sinks that don't buffer do nothing
+     */
+    virtual void Flush() {
+    }
+};
+
+/**
+ * @brief An OutputSink that writes to a std::ostream
+ */
+class StreamOutputSink : public OutputSink {
+  public:
+    explicit StreamOutputSink(std::ostream &stream) : stream(stream) {
+    }
+
+    void Write(std::string_view data) override {
+        stream.write(data.data(), static_cast<std::streamsize>(data.size()));
+    }
+
+    void Flush() override {
+        stream.flush();
+    }
+
+  private:
+    std::ostream &stream;
+};
+
+/**
+ * @brief An OutputSink that appends to a string
+ */
+class StringOutputSink : public OutputSink {
+  public:
+    void Write(std::string_view data) override {
+        out += data;
+    }
+
+    std::string out;
+};
+
+namespace detail {
+/**
+ * @brief An OutputSink that discards everything
+ */
+class NullOutputSink : public OutputSink {
+  public:
+    void Write(std::string_view) override {
+    }
+};
+} // namespace detail
+
+#ifdef EASYCLI_POSIX
+namespace detail {
+/**
+ * @brief Writes first and then second to fd, both in a single writev call unless the write is partial
+ *
+ * @return false if a write failed
+ */
+inline bool WriteAll(int fd, std::string_view first, std::string_view second = std::string_view()) {
+    while (!first.empty() || !second.empty()) {
+        iovec parts[2];
+        int count = 0;
+        for (std::string_view part : {first, second}) {
+            if (!part.empty()) {
+                parts[count].iov_base = const_cast<char *>(part.data());
+                parts[count].iov_len = part.size();
+                count++;
+            }
+        }
+        const ssize_t written = ::writev(fd, parts, count);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        const std::size_t from_first = std::min(static_cast<std::size_t>(written), first.size());
+        first.remove_prefix(from_first);
+        second.remove_prefix(static_cast<std::size_t>(written) - from_first);
+    }
+    return true;
+}
+} // namespace detail
+
+/**
+ * @brief An OutputSink that writes straight to a file descriptor, without any buffering
+ * @remark Only available on POSIX systems
+ */
+class FdOutputSink : public OutputSink {
+  public:
+    explicit FdOutputSink(int fd) : fd(fd) {
+    }
+
+    void Write(std::string_view data) override {
+        detail::WriteAll(fd, data);
+    }
+
+  private:
+    int fd;
+};
+#endif
+
+/**
+ * @brief An OutputSink that collects output in memory and passes it on in large writes, then flushes its target
+ * @remark Output is passed on once flush_bytes are buffered, when the oldest buffered byte is older than max_delay, on Flush()
+ *         and on destruction. The delay is only checked when output is written, so call Flush() before waiting for more work
+ * @remark It can also write to a file descriptor (POSIX only). Then a write that doesn't fit in the buffer goes out in the same
+ *         writev call as what was buffered, without being copied
+ */
+class BufferedOutputSink : public OutputSink {
+  public:
+    static constexpr std::size_t kDefaultFlushBytes = 64 * 1024;
+    static constexpr std::chrono::milliseconds kDefaultMaxDelay{100};
+
+    /**
+     * @param target The sink to pass the output on to. It must outlive this sink
+     * @param flush_bytes How much output to collect before passing it on
+     * @param max_delay How long output may wait in the buffer. std::chrono::milliseconds::max() for no limit
+     */
+    explicit BufferedOutputSink(OutputSink &target, std::size_t flush_bytes = kDefaultFlushBytes, std::chrono::milliseconds max_delay = kDefaultMaxDelay)
+        : target(&target), flush_bytes(flush_bytes), max_delay(max_delay) {
+        buffer.reserve(flush_bytes);
+    }
+
+#ifdef EASYCLI_POSIX
+    /**
+     * @param fd The file descriptor to write to. It is not closed
+     * @param flush_bytes How much output to collect before writing it
+     * @param max_delay How long output may wait in the buffer. std::chrono::milliseconds::max() for no limit
+     */
+    explicit BufferedOutputSink(int fd, std::size_t flush_bytes = kDefaultFlushBytes, std::chrono::milliseconds max_delay = kDefaultMaxDelay)
+        : fd(fd), flush_bytes(flush_bytes), max_delay(max_delay) {
+        buffer.reserve(flush_bytes);
+    }
+#endif
+
+    BufferedOutputSink(const BufferedOutputSink &) = delete;
+    BufferedOutputSink &operator=(const BufferedOutputSink &) = delete;
+
+    ~BufferedOutputSink() override {
+        Flush();
+    }
+
+    void Write(std::string_view data) override {
+        if (buffer.size() + data.size() > flush_bytes) {
+            Send(data);
+            return;
+        }
+        // Reading the clock costs about as much as the rest of a write, so it is skipped without a delay limit
+        const bool timed = max_delay != std::chrono::milliseconds::max();
+        if (timed && buffer.empty()) {
+            oldest = std::chrono::steady_clock::now();
+        }
+        buffer += data;
+        if (buffer.size() >= flush_bytes || (timed && std::chrono::steady_clock::now() - oldest >= max_delay)) {
+            Send(std::string_view());
+        }
+    }
+
+    void Flush() override {
+        Send(std::string_view());
+    }
+
+  private:
+    // Passes on the buffer followed by data, then flushes the target
+    void Send(std::string_view data) {
+#ifdef EASYCLI_POSIX
+        if (target == nullptr) {
+            detail::WriteAll(fd, buffer, data);
+            buffer.clear();
+            return;
+        }
+#endif
+        if (!buffer.empty()) {
+            target->Write(buffer);
+            buffer.clear();
+        }
+        if (!data.empty()) {
+            target->Write(data);
+        }
+        target->Flush();
+    }
+
+    OutputSink *target = nullptr;
+#ifdef EASYCLI_POSIX
+    int fd = -1;
+#endif
+    std::size_t flush_bytes;
+    std::chrono::milliseconds max_delay;
+    std::chrono::steady_clock::time_point oldest;
+    std::string buffer;
+};
+
+namespace detail {
+// How much output a pipeline stage collects before handing it to the next stage, and how many chunks may wait between two stages
+constexpr std::size_t kPipeChunkBytes = 16 * 1024;
+constexpr std::size_t kPipeQueueChunks = 4;
+
+/**
+ * @brief The bounded queue of chunks between two stages of a pipeline
+ * @remark Chunks are moved through the queue, and the reader hands back the buffer of each chunk it is done with for the
+ *         writer to fill again, so once a pipeline is running no chunk is copied or allocated
+ */
+class ChunkQueue {
+  public:
+    explicit ChunkQueue(std::size_t capacity) : capacity(std::max<std::size_t>(capacity, 1)) {
+    }
+
+    /**
+     * @brief Queues chunk, waiting while the queue is full, and replaces it with an empty buffer to fill next
+     *
+     * @return false if the reader has returned, in which case the chunk is dropped
+     */
+    bool Push(std::string &chunk) {
+        std::unique_lock<std::mutex> lock(mutex);
+        space.wait(lock, [this] { return chunks.size() < capacity || reader_closed; });
+        if (reader_closed) {
+            chunk.clear();
+            return false;
+        }
+        chunks.push_back(std::move(chunk));
+        if (!spare.empty()) {
+            chunk = std::move(spare.back());
+            spare.pop_back();
+        } else {
+            chunk = std::string();
+        }
+        chunk.clear();
+        ready.notify_one();
+        return true;
+    }
+
+    /**
+     * @brief Takes the next chunk, waiting until there is one, and recycles the buffer chunk held
+     *
+     * @return false once the writer has closed the queue and every chunk was taken
+     */
+    bool Pop(std::string &chunk) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (chunk.capacity() != 0 && spare.size() <= capacity) {
+            spare.push_back(std::move(chunk));
+        }
+        ready.wait(lock, [this] { return !chunks.empty() || writer_closed; });
+        if (chunks.empty()) {
+            chunk.clear();
+            return false;
+        }
+        chunk = std::move(chunks.front());
+        chunks.pop_front();
+        space.notify_one();
+        return true;
+    }
+
+    // Called once the writing stage has returned
+    void CloseWriter() {
+        std::lock_guard<std::mutex> lock(mutex);
+        writer_closed = true;
+        ready.notify_all();
+    }
+
+    // Called once the reading stage has returned. Later and waiting pushes drop their chunk
+    void CloseReader() {
+        std::lock_guard<std::mutex> lock(mutex);
+        reader_closed = true;
+        chunks.clear();
+        space.notify_all();
+    }
+
+  private:
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::condition_variable space;
+    std::deque<std::string> chunks;
+    std::vector<std::string> spare;
+    std::size_t capacity;
+    bool writer_closed = false;
+    bool reader_closed = false;
+};
+
+/**
+ * @brief The OutputSink of a pipeline stage: collects the output into chunks and pushes them to the next stage
+ * @remark Chunks are never bigger than chunk_bytes, however big the writes are, so a command that returns its whole output
+ *         at once still goes through the queue a chunk at a time
+ * @remark Flush() pushes a partial chunk, so a stage can hand over what it has before doing slow work
+ */
+class PipeOutputSink : public OutputSink {
+  public:
+    PipeOutputSink(ChunkQueue &queue, std::size_t chunk_bytes) : queue(queue), chunk_bytes(std::max<std::size_t>(chunk_bytes, 1)) {
+    }
+
+    void Write(std::string_view data) override {
+        while (!data.empty() && !reader_gone) {
+            if (chunk.capacity() < chunk_bytes) {
+                chunk.reserve(chunk_bytes);
+            }
+            const std::size_t piece = std::min(data.size(), chunk_bytes - chunk.size());
+            chunk.append(data.data(), piece);
+            data.remove_prefix(piece);
+            if (chunk.size() == chunk_bytes) {
+                Send();
+            }
+        }
+    }
+
+    void Flush() override {
+        if (!chunk.empty()) {
+            Send();
+        }
+    }
+
+  private:
+    void Send() {
+        // Once the next stage has returned, the rest of the output is dropped without being copied
+        reader_gone = !queue.Push(chunk);
+    }
+
+    ChunkQueue &queue;
+    std::size_t chunk_bytes;
+    std::string chunk;
+    bool reader_gone = false;
+};
+
+/**
+ * @brief The InputSource of a pipeline stage: pops the chunks the previous stage pushed
+ */
+class PipeInputSource : public InputSource {
+  public:
+    explicit PipeInputSource(ChunkQueue &queue) : queue(queue) {
+    }
+
+    bool Read(std::string_view &data) override {
+        if (!queue.Pop(chunk)) {
+            return false;
+        }
+        data = chunk;
+        return true;
+    }
+
+  private:
+    ChunkQueue &queue;
+    std::string chunk;
+};
+} // namespace detail
+
+namespace detail {
+template <typename F> constexpr bool IsRegularCommand = std::is_invocable_r_v<CommandOutput, const F &, const CommandArguments &>;
+template <typename F> constexpr bool IsStreamingCommand = std::is_invocable_r_v<CommandOutput, const F &, const CommandArguments &, OutputSink &>;
+} // namespace detail
+
+/**
+ * @brief The callable type stored in CommandMap: anything that can be called as `CommandOutput(const CommandArguments &)`
+ * @remark This replaces `std::function`. Function pointers and callables of up to 4 pointers in size are stored inline,
+ *         so registering them never allocates, and a call is a single indirect call through a stored invoker
+ * @remark Bigger callables are stored on the heap, like `std::function` does. Calling an empty CommandFunction throws std::bad_function_call
+ * @remark It also accepts streaming commands, called as `CommandOutput(const CommandArguments &, OutputSink &)`. Either kind can be called
+ *         either way: a streaming command called without a sink has its output collected into `out`, and a regular command called
+ *         with a sink has its `out` written to the sink on success. A streaming command writes its output to the sink and returns
+ *         `success` (plus an error message in `out` on failure); anything it returns in `out` on success is written after what it streamed
+ * @remark A callable accepting both signatures is called directly either way, and must write its own output to the sink
+ */
+class CommandFunction {
+  public:
+    CommandFunction() noexcept {
+    }
+
+    CommandFunction(std::nullptr_t) noexcept {
+    }
+
+    template <typename F, typename D = std::decay_t<F>, typename = std::enable_if_t<!std::is_same_v<D, CommandFunction> && (detail::IsRegularCommand<D> || detail::IsStreamingCommand<D>)>>
+    CommandFunction(F &&f) {
+        // A function passed by reference decays to a pointer but can never be null, so only pointers passed as pointers are checked
+        if constexpr (std::is_pointer_v<std::remove_reference_t<F>> || std::is_member_pointer_v<std::remove_reference_t<F>>) {
+            if (f == nullptr) {
+                return;
+            }
+        }
+        if constexpr (IsInline<D>()) {
+            ::new (static_cast<void *>(&storage)) D(std::forward<F>(f));
+        } else {
+            storage.heap = new D(std::forward<F>(f));
+        }
+        invoker = &Invoke<D>;
+        sink_invoker = &InvokeWithSink<D>;
+        manager = &Manage<D>;
+    }
+
+    CommandFunction(const CommandFunction &other) {
+        if (other.manager != nullptr) {
+            other.manager(Operation::Copy, const_cast<Storage &>(other.storage), storage);
+            invoker = other.invoker;
+            sink_invoker = other.sink_invoker;
+            manager = other.manager;
+        }
+        known_flags = other.known_flags;
+    }
+
+    CommandFunction(CommandFunction &&other) noexcept {
+        MoveFrom(other);
+    }
+
+    CommandFunction &operator=(const CommandFunction &other) {
+        if (this != &other) {
+            CommandFunction copy(other);
+            Reset();
+            MoveFrom(copy);
+        }
+        return *this;
+    }
+
+    CommandFunction &operator=(CommandFunction &&other) noexcept {
+        if (this != &other) {
+            Reset();
+            MoveFrom(other);
+        }
+        return *this;
+    }
+
+    ~CommandFunction() {
+        Reset();
+    }
+
+    CommandOutput operator()(const CommandArguments &args) const {
+        if (invoker == nullptr) {
+            throw std::bad_function_call();
+        }
+        return invoker(storage, args);
+    }
+
+    /**
+     * @brief Calls the command, writing its output to sink
+     *
+     * @return CommandOutput The success of the command, and its error message on failure
+     */
+    CommandOutput operator()(const CommandArguments &args, OutputSink &sink) const {
+        if (sink_invoker == nullptr) {
+            throw std::bad_function_call();
+        }
+        return sink_invoker(storage, args, sink);
+    }
+
+    explicit operator bool() const noexcept {
+        return invoker != nullptr;
+    }
+
+    /**
+     * @brief Returns a pointer to the stored callable if it is of type T, like `std::function::target`
+     */
+    template <typename T> const T *target() const noexcept {
+        return manager == &Manage<T> ? static_cast<const T *>(Get<T>(const_cast<Storage &>(storage))) : nullptr;
+    }
+
+    /**
+     * @brief The flags declared when the command was registered, or nullptr
+     */
+    const std::shared_ptr<const FlagSet> &KnownFlags() const noexcept {
+        return known_flags;
+    }
+
+    void SetKnownFlags(std::shared_ptr<const FlagSet> flags) noexcept {
+        known_flags = std::move(flags);
+    }
+
+  private:
+    union Storage {
+        alignas(std::max_align_t) unsigned char buffer[4 * sizeof(void *)];
+        void *heap;
+    };
+
+    enum class Operation { Copy, Move, Destroy };
+
+    using Invoker = CommandOutput (*)(const Storage &, const CommandArguments &);
+    using SinkInvoker = CommandOutput (*)(const Storage &, const CommandArguments &, OutputSink &);
+    using Manager = void (*)(Operation, Storage &, Storage &);
+
+    template <typename D> static constexpr bool IsInline() {
+        return sizeof(D) <= sizeof(Storage) && alignof(D) <= alignof(Storage) && std::is_nothrow_move_constructible_v<D>;
+    }
+
+    template <typename D> static D *Get(Storage &storage) {
+        if constexpr (IsInline<D>()) {
+            return std::launder(reinterpret_cast<D *>(&storage));
+        } else {
+            return static_cast<D *>(storage.heap);
+        }
+    }
+
+    template <typename D> static CommandOutput Invoke(const Storage &storage, const CommandArguments &args) {
+        const D &callable = *Get<D>(const_cast<Storage &>(storage));
+        if constexpr (detail::IsRegularCommand<D>) {
+            return std::invoke(callable, args);
+        } else {
+            // Collect the streamed output into out
+            StringOutputSink sink;
+            CommandOutput out = std::invoke(callable, args, sink);
+            if (out.success) {
+                sink.Write(out.out);
+                out.out = std::move(sink.out);
+            }
+            return out;
+        }
+    }
+
+    template <typename D> static CommandOutput InvokeWithSink(const Storage &storage, const CommandArguments &args, OutputSink &sink) {
+        const D &callable = *Get<D>(const_cast<Storage &>(storage));
+        if constexpr (detail::IsRegularCommand<D> && detail::IsStreamingCommand<D>) {
+            return std::invoke(callable, args, sink);
+        } else {
+            CommandOutput out;
+            if constexpr (detail::IsStreamingCommand<D>) {
+                out = std::invoke(callable, args, sink);
+            } else {
+                out = std::invoke(callable, args);
+            }
+            if (out.success && !out.out.empty()) {
+                sink.Write(out.out);
+            }
+            return out;
+        }
+    }
+
+    // Copies, moves or destroys the callable in `from`. Moving leaves `from` destroyed
+    template <typename D> static void Manage(Operation operation, Storage &from, Storage &to) {
+        if constexpr (IsInline<D>()) {
+            D *callable = Get<D>(from);
+            if (operation == Operation::Copy) {
+                ::new (static_cast<void *>(&to)) D(*callable);
+            } else if (operation == Operation::Move) {
+                ::new (static_cast<void *>(&to)) D(std::move(*callable));
+                callable->~D();
+            } else {
+                callable->~D();
+            }
+        } else {
+            if (operation == Operation::Copy) {
+                to.heap = new D(*Get<D>(from));
+            } else if (operation == Operation::Move) {
+                to.heap = from.heap;
+            } else {
+                delete Get<D>(from);
+            }
+        }
+    }
+
+    void MoveFrom(CommandFunction &other) noexcept {
+        if (other.manager != nullptr) {
+            other.manager(Operation::Move, other.storage, storage);
+            invoker = std::exchange(other.invoker, nullptr);
+            sink_invoker = std::exchange(other.sink_invoker, nullptr);
+            manager = std::exchange(other.manager, nullptr);
+        }
+        known_flags = std::move(other.known_flags);
+    }
+
+    void Reset() noexcept {
+        if (manager != nullptr) {
+            manager(Operation::Destroy, storage, storage);
+            invoker = nullptr;
+            sink_invoker = nullptr;
+            manager = nullptr;
+        }
+        known_flags.reset();
+    }
+
+    Storage storage;
+    Invoker invoker = nullptr;
+    SinkInvoker sink_invoker = nullptr;
+    Manager manager = nullptr;
+    std::shared_ptr<const FlagSet> known_flags;
+};
+
+namespace detail {
+/**
+ * @brief Sets the bit of every flag in args that fn declared at registration, right before fn is called
+ */
+inline void ResolveFlags(CommandArguments &args, const CommandFunction &fn) {
+    args.flag_bits.reset();
+    args.known_flags = fn.KnownFlags().get();
+    if (args.known_flags == nullptr) {
+        return;
+    }
+    for (const std::string &flag : args.flags) {
+        const std::size_t index = args.known_flags->IndexOf(flag);
+        if (index < FlagSet::kMaxFlags) {
+            args.flag_bits.set(index);
+        }
+    }
+}
+} // namespace detail
+
+using CommandMap = std::unordered_map<std::string, CommandFunction, CommandNameHash, std::equal_to<>>;
+
+namespace detail {
+/**
+ * @brief Looks a command up by name, hashing the name only once
+ *
+ * @return A pointer to the registered function, or nullptr if there is no command with that name
+ */
+inline const CommandFunction *FindCommand(const CommandMap &commands, std::string_view name) {
+#ifdef __cpp_lib_generic_unordered_lookup
+    const auto it = commands.find(name);
+#else
+    // Heterogeneous lookup in unordered containers needs C++20
+    const auto it = commands.find(std::string(name));
+#endif
+    return it != commands.end() ? &it->second : nullptr;
+}
+
+constexpr std::size_t kReaderSlots = 64;
+
+// Bumped after any command is registered in any EasyCLI, so PreparedCommand handles know to look their command up again
+inline std::atomic<std::uint64_t> registry_generation{0};
+
+/**
+ * @brief The reader slot of the calling thread. Threads are spread over the slots so they don't share a counter
+ */
+inline std::size_t ThreadSlot() {
+    static std::atomic<std::size_t> next_slot{0};
+    thread_local const std::size_t slot = next_slot.fetch_add(1, std::memory_order_relaxed) % kReaderSlots;
+    return slot;
+}
+
+class RadixTrie;
+
+/**
+ * @brief One published version of the registry
+ */
+struct RegistrySnapshot {
+    CommandMap commands;
+    // The command names, so abbreviations resolve without locking. Only kept when abbreviations are enabled
+    std::shared_ptr<const RadixTrie> names;
+};
+
+/**
+ * @brief Read-copy-update storage of a CommandMap for EasyCLI's concurrent mode
+ * @remark Readers increment the counter of their thread's slot and load the current snapshot, without locking.
+ *         Writers copy the map, publish the copy and free the old snapshots once the readers that started before it are done
+ */
+class SnapshotRegistry {
+  public:
+    // Readers count themselves in the counter picked by the parity of the epoch they started in
+    struct alignas(64) ReaderSlot {
+        std::array<std::atomic<std::size_t>, 2> count{};
+    };
+
+    explicit SnapshotRegistry(const CommandMap &commands, std::shared_ptr<const RadixTrie> names = nullptr)
+        : owned(std::make_unique<const RegistrySnapshot>(RegistrySnapshot{commands, std::move(names)})), current(owned.get()) {
+    }
+
+    /**
+     * @brief Publishes a new snapshot, and frees the old ones no reader can still be using. Must be called with the writer mutex held
+     */
+    void Publish(const CommandMap &commands, std::shared_ptr<const RadixTrie> names = nullptr) {
+        std::unique_ptr<const RegistrySnapshot> next = std::make_unique<const RegistrySnapshot>(RegistrySnapshot{commands, std::move(names)});
+        current.store(next.get());
+        waiting.push_back(std::move(owned));
+        owned = std::move(next);
+        Reclaim();
+    }
+
+    /**
+     * @brief The number of old snapshots not freed yet. Must be called with the writer mutex held
+     */
+    std::size_t RetiredCount() const {
+        return draining.size() + waiting.size();
+    }
+
+    std::mutex writer;
+    std::array<ReaderSlot, kReaderSlots> readers;
+
+  private:
+    friend class RegistryReadGuard;
+
+    // Snapshots are freed in grace periods. Starting one moves the waiting snapshots to draining and bumps the epoch, so new
+    // readers count themselves in the other counter of their slot and load a newer snapshot. Once the counters of the old
+    // epoch have all been seen at 0, nobody can be using a draining snapshot. Readers never wait, and a period ends however
+    // busy the registry is, since only the readers that started before it hold it open
+    void Reclaim() {
+        for (;;) {
+            if (!draining.empty()) {
+                const std::size_t parity = (epoch.load() - 1) & 1;
+                for (const ReaderSlot &slot : readers) {
+                    if (slot.count[parity].load() != 0) {
+                        return;
+                    }
+                }
+                draining.clear();
+            }
+            if (waiting.empty()) {
+                return;
+            }
+            draining.swap(waiting);
+            epoch.fetch_add(1);
+        }
+    }
+
+    std::unique_ptr<const RegistrySnapshot> owned;
+    std::atomic<const RegistrySnapshot *> current;
+    std::atomic<std::uint64_t> epoch{0};
+    // Retired snapshots, in the grace period in progress and waiting for the next one
+    std::vector<std::unique_ptr<const RegistrySnapshot>> draining;
+    std::vector<std::unique_ptr<const RegistrySnapshot>> waiting;
+};
+
+/**
+ * @brief Keeps the registry an EasyCLI reads from alive while a command runs
+ */
+class RegistryReadGuard {
+  public:
+    explicit RegistryReadGuard(const CommandMap &commands) : commands(&commands) {
+    }
+
+    explicit RegistryReadGuard(SnapshotRegistry &registry) {
+        SnapshotRegistry::ReaderSlot &reader = registry.readers[ThreadSlot()];
+        for (;;) {
+            const std::uint64_t epoch = registry.epoch.load();
+            slot = &reader.count[epoch & 1];
+            slot->fetch_add(1);
+            // If a grace period started meanwhile, the writer may already have seen this counter at 0
+            if (registry.epoch.load() == epoch) {
+                break;
+            }
+            slot->fetch_sub(1);
+        }
+        const RegistrySnapshot *snapshot = registry.current.load();
+        commands = &snapshot->commands;
+        names = snapshot->names.get();
+    }
+
+    RegistryReadGuard(const RegistryReadGuard &) = delete;
+    RegistryReadGuard &operator=(const RegistryReadGuard &) = delete;
+
+    ~RegistryReadGuard() {
+        if (slot != nullptr) {
+            slot->fetch_sub(1, std::memory_order_release);
+        }
+    }
+
+    const CommandMap &Commands() const {
+        return *commands;
+    }
+
+    const CommandFunction *Find(std::string_view name) const {
+        return FindCommand(*commands, name);
+    }
+
+    /**
+     * @brief The command names of the snapshot, or nullptr when reading the live map or without abbreviations
+     */
+    const RadixTrie *Names() const {
+        return names;
+    }
+
+  private:
+    const CommandMap *commands = nullptr;
+    const RadixTrie *names = nullptr;
+    std::atomic<std::size_t> *slot = nullptr;
+};
+} // namespace detail
+
+/**
+ * @brief A snapshot of the statistics of one command, see EasyCLI::EnableInstrumentation
+ */
+struct CommandStats {
+    std::string name;
+    std::uint64_t calls = 0;
+    std::uint64_t successes = 0;
+    std::uint64_t failures = 0;
+    // Calls that were still running at their deadline. They are counted as failures too
+    std::uint64_t timeouts = 0;
+    // Call counts per latency bucket, see LatencyBucketLowerBound for the range of each bucket
+    std::vector<std::uint64_t> latency_buckets;
+
+    /**
+     * @brief Returns the lower bound in nanoseconds of a latency bucket. Buckets are exact below 8ns, then each power of two
+     *        is split into 8 buckets, so a latency is known to within 12.5%
+     */
+    static std::uint64_t LatencyBucketLowerBound(std::size_t bucket) {
+        if (bucket < 8) {
+            return bucket;
+        }
+        const std::size_t exponent = bucket / 8 + 2;
+        return static_cast<std::uint64_t>(8 + bucket % 8) << (exponent - 3);
+    }
+
+    /**
+     * @brief Returns an upper bound in nanoseconds of the given latency percentile
+     *
+     * @param percentile The percentile, between 0 and 100
+     * @return The latency in nanoseconds, or 0 if the command was never called
+     */
+    std::uint64_t LatencyPercentile(double percentile) const {
+        std::uint64_t total = 0;
+        for (std::uint64_t count : latency_buckets) {
+            total += count;
+        }
+        if (total == 0) {
+            return 0;
+        }
+        const double target = percentile / 100.0 * static_cast<double>(total);
+        std::uint64_t seen = 0;
+        for (std::size_t bucket = 0; bucket < latency_buckets.size(); bucket++) {
+            seen += latency_buckets[bucket];
+            if (latency_buckets[bucket] != 0 && static_cast<double>(seen) >= target) {
+                return bucket + 1 < latency_buckets.size() ? LatencyBucketLowerBound(bucket + 1) : LatencyBucketLowerBound(bucket);
+            }
+        }
+        return LatencyBucketLowerBound(latency_buckets.size() - 1);
+    }
+};
+
+namespace detail {
+// Latencies up to 2^40ns (about 18 minutes) get their own bucket, longer ones share the last
+constexpr std::size_t kLatencyBuckets = (40 - 2 + 1) * 8;
+constexpr std::size_t kStatsStripes = 8;
+
+/**
+ * @brief The latency bucket of a duration in nanoseconds, see CommandStats::LatencyBucketLowerBound
+ */
+inline std::size_t LatencyBucket(std::uint64_t nanoseconds) {
+    if (nanoseconds < 8) {
+        return static_cast<std::size_t>(nanoseconds);
+    }
+    std::size_t exponent = 0;
+    for (std::uint64_t value = nanoseconds; value > 1; value >>= 1) {
+        exponent++;
+    }
+    const std::size_t bucket = (exponent - 2) * 8 + ((nanoseconds >> (exponent - 3)) & 7);
+    return std::min(bucket, kLatencyBuckets - 1);
+}
+
+/**
+ * @brief The live counters of one command. Each thread updates the stripe of its reader slot with relaxed atomics,
+ *        and stripes are only allocated once a thread using them calls the command, so idle commands stay small
+ */
+class CommandStatsCounters {
+  public:
+    struct Stripe {
+        std::atomic<std::uint64_t> calls{0};
+        std::atomic<std::uint64_t> successes{0};
+        std::atomic<std::uint64_t> timeouts{0};
+        std::array<std::atomic<std::uint64_t>, kLatencyBuckets> latency{};
+    };
+
+    ~CommandStatsCounters() {
+        for (std::atomic<Stripe *> &stripe : stripes) {
+            delete stripe.load();
+        }
+    }
+
+    void Record(bool success, std::uint64_t nanoseconds, bool timed_out = false) {
+        Stripe &stripe = GetStripe(ThreadSlot() % kStatsStripes);
+        stripe.calls.fetch_add(1, std::memory_order_relaxed);
+        if (success) {
+            stripe.successes.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (timed_out) {
+            stripe.timeouts.fetch_add(1, std::memory_order_relaxed);
+        }
+        stripe.latency[LatencyBucket(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    CommandStats Snapshot(const std::string &name) const {
+        CommandStats stats;
+        stats.name = name;
+        stats.latency_buckets.assign(kLatencyBuckets, 0);
+        for (const std::atomic<Stripe *> &slot : stripes) {
+            if (const Stripe *stripe = slot.load(std::memory_order_acquire)) {
+                stats.calls += stripe->calls.load(std::memory_order_relaxed);
+                stats.successes += stripe->successes.load(std::memory_order_relaxed);
+                stats.timeouts += stripe->timeouts.load(std::memory_order_relaxed);
+                for (std::size_t bucket = 0; bucket < kLatencyBuckets; bucket++) {
+                    stats.latency_buckets[bucket] += stripe->latency[bucket].load(std::memory_order_relaxed);
+                }
+            }
+        }
+        stats.failures = stats.calls - std::min(stats.calls, stats.successes);
+        return stats;
+    }
+
+    // Calls recorded while resetting may be partly lost, which is fine for statistics
+    void Reset() {
+        for (std::atomic<Stripe *> &slot : stripes) {
+            if (Stripe *stripe = slot.load(std::memory_order_acquire)) {
+                stripe->calls.store(0, std::memory_order_relaxed);
+                stripe->successes.store(0, std::memory_order_relaxed);
+                stripe->timeouts.store(0, std::memory_order_relaxed);
+                for (std::atomic<std::uint64_t> &count : stripe->latency) {
+                    count.store(0, std::memory_order_relaxed);
+                }
+            }
+        }
+    }
+
+  private:
+    Stripe &GetStripe(std::size_t index) {
+        Stripe *stripe = stripes[index].load(std::memory_order_acquire);
+        if (stripe == nullptr) {
+            Stripe *created = new Stripe();
+            if (stripes[index].compare_exchange_strong(stripe, created, std::memory_order_acq_rel)) {
+                stripe = created;
+            } else {
+                delete created;
+            }
+        }
+        return *stripe;
+    }
+
+    std::array<std::atomic<Stripe *>, kStatsStripes> stripes{};
+};
+
+/**
+ * @brief The counters of every instrumented command, by name
+ */
+struct StatsTable {
+    std::mutex mutex;
+    std::unordered_map<std::string, std::shared_ptr<CommandStatsCounters>> counters;
+
+    std::shared_ptr<CommandStatsCounters> Get(const std::string &name) {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::shared_ptr<CommandStatsCounters> &entry = counters[name];
+        if (!entry) {
+            entry = std::make_shared<CommandStatsCounters>();
+        }
+        return entry;
+    }
+
+    std::vector<CommandStats> Snapshot() {
+        std::vector<CommandStats> stats;
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto &entry : counters) {
+            stats.push_back(entry.second->Snapshot(entry.first));
+        }
+        std::sort(stats.begin(), stats.end(), [](const CommandStats &a, const CommandStats &b) { return a.name < b.name; });
+        return stats;
+    }
+
+    void Reset() {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto &entry : counters) {
+            entry.second->Reset();
+        }
+    }
+};
+
+/**
+ * @brief Wraps a registered command to time it and count its calls. It forwards both call signatures, so streaming is kept
+ */
+struct InstrumentedCommand {
+    CommandFunction fn;
+    std::shared_ptr<CommandStatsCounters> counters;
+
+    CommandOutput operator()(const CommandArguments &args) const {
+        const auto start = std::chrono::steady_clock::now();
+        CommandOutput out = fn(args);
+        Record(*counters, out, args, start);
+        return out;
+    }
+
+    CommandOutput operator()(const CommandArguments &args, OutputSink &sink) const {
+        const auto start = std::chrono::steady_clock::now();
+        CommandOutput out = fn(args, sink);
+        Record(*counters, out, args, start);
+        return out;
+    }
+
+    // A call that was cancelled or ran past its deadline is a failure, whatever it returned, since the caller gets an error
+    static void Record(CommandStatsCounters &counters, const CommandOutput &out, const CommandArguments &args, std::chrono::steady_clock::time_point start) {
+        const auto end = std::chrono::steady_clock::now();
+        const bool timed_out = args.deadline != std::chrono::steady_clock::time_point::max() && end >= args.deadline;
+        const bool success = out.success && !timed_out && !args.cancellation.IsCancelled();
+        counters.Record(success, static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()), timed_out);
+    }
+};
+
+/**
+ * @brief Formats statistics as the table printed by the built-in `stats` command
+ */
+inline std::string FormatStats(const std::vector<CommandStats> &stats) {
+    std::ostringstream out;
+    out << std::left << std::setw(24) << "command" << std::right << std::setw(12) << "calls" << std::setw(12) << "failures" << std::setw(12) << "timeouts"
+        << std::setw(14) << "p50 (ns)" << std::setw(14) << "p99 (ns)";
+    for (const CommandStats &command : stats) {
+        out << '\n'
+            << std::left << std::setw(24) << command.name << std::right << std::setw(12) << command.calls << std::setw(12) << command.failures << std::setw(12)
+            << command.timeouts << std::setw(14) << command.LatencyPercentile(50) << std::setw(14) << command.LatencyPercentile(99);
+    }
+    return out.str();
+}
+} // namespace detail
+
+/**
+ * @brief A fixed-size thread pool where each worker has its own task queue and idle workers steal from the others
+ * @remark Workers take their own newest task first and steal the oldest task of another queue, so a batch split into chunks
+ *         keeps every worker busy even when some chunks are much slower than others
+ */
+class WorkStealingPool {
+  public:
+    using Task = std::function<void()>;
+
+    /**
+     * @param threads The number of worker threads. 0 means one per hardware thread
+     */
+    explicit WorkStealingPool(std::size_t threads = 0) {
+        if (threads == 0) {
+            threads = std::max<std::size_t>(1, std::thread::hardware_concurrency());
+        }
+        queues = std::vector<Queue>(threads);
+        workers.reserve(threads);
+        for (std::size_t i = 0; i < threads; i++) {
+            workers.emplace_back([this, i] { WorkerLoop(i); });
+        }
+    }
+
+    WorkStealingPool(const WorkStealingPool &) = delete;
+    WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+    /**
+     * @brief Runs the tasks still queued, then joins the workers
+     */
+    ~WorkStealingPool() {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread &worker : workers) {
+            worker.join();
+        }
+    }
+
+    /**
+     * @brief Queues a task. Tasks submitted from a worker go to that worker's queue, others are spread round-robin
+     * @remark Tasks should catch their own exceptions. One that escapes is dropped, so it can't end the worker, nor unwind
+     *         a thread that ran the task while waiting on its own work
+     */
+    void Submit(Task task) {
+        const std::size_t index = current_worker != nullptr && current_pool == this ? *current_worker : next_queue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+        {
+            std::lock_guard<std::mutex> lock(queues[index].mutex);
+            queues[index].tasks.push_back(std::move(task));
+        }
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+            pending++;
+        }
+        wake.notify_one();
+    }
+
+    /**
+     * @brief Runs one queued task on the calling thread, if there is one
+     * @remark Threads waiting on work they submitted call this, so waiting from inside a task can't deadlock the pool
+     *
+     * @return true if a task was run
+     */
+    bool TryRunOne() {
+        const std::size_t start = current_pool == this ? *current_worker : next_queue.load(std::memory_order_relaxed);
+        Task task;
+        if (!TryPop(start % queues.size(), task)) {
+            return false;
+        }
+        Run(task);
+        return true;
+    }
+
+    std::size_t Size() const {
+        return workers.size();
+    }
+
+    /**
+     * @brief Returns true when called from one of this pool's workers
+     */
+    bool OnWorkerThread() const noexcept {
+        return current_pool == this;
+    }
+
+  private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    // Takes the newest task of queue `own`, or else steals the oldest task of another queue
+    bool TryPop(std::size_t own, Task &task) {
+        for (std::size_t i = 0; i < queues.size(); i++) {
+            Queue &queue = queues[(own + i) % queues.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (!queue.tasks.empty()) {
+                if (i == 0) {
+                    task = std::move(queue.tasks.back());
+                    queue.tasks.pop_back();
+                } else {
+                    task = std::move(queue.tasks.front());
+                    queue.tasks.pop_front();
+                }
+                std::lock_guard<std::mutex> sleep_lock(sleep_mutex);
+                pending--;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static void Run(Task &task) noexcept {
+        try {
+            task();
+        } catch (...) {
+        }
+    }
+
+    void WorkerLoop(std::size_t index) {
+        current_pool = this;
+        current_worker = &index;
+        while (true) {
+            Task task;
+            if (TryPop(index, task)) {
+                Run(task);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleep_mutex);
+            wake.wait(lock, [this] { return pending > 0 || stopping; });
+            if (pending == 0 && stopping) {
+                break;
+            }
+        }
+        current_pool = nullptr;
+        current_worker = nullptr;
+    }
+
+    static inline thread_local WorkStealingPool *current_pool = nullptr;
+    static inline thread_local const std::size_t *current_worker = nullptr;
+
+    std::vector<Queue> queues;
+    std::vector<std::thread> workers;
+    std::atomic<std::size_t> next_queue{0};
+    std::mutex sleep_mutex;
+    std::condition_variable wake;
+    std::size_t pending = 0;
+    bool stopping = false;
+};
+
+#ifdef EASYCLI_COROUTINES
+/**
+ * @brief The return type of a coroutine command, like `CommandTask fetch(const CommandArguments &args)`, which ends with `co_return CommandOutput{...};`
+ * @remark A task starts when it is awaited and resumes its awaiter when it finishes, so commands can co_await each other.
+ *         An exception thrown by the coroutine is rethrown to its awaiter. Only available in C++20
+ */
+class CommandTask {
+  public:
+    struct promise_type {
+        CommandOutput output;
+        std::exception_ptr exception;
+        std::coroutine_handle<> continuation = std::noop_coroutine();
+
+        CommandTask get_return_object() noexcept {
+            return CommandTask(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        std::suspend_always initial_suspend() noexcept {
+            return {};
+        }
+
+        auto final_suspend() noexcept {
+            struct ResumeAwaiter {
+                bool await_ready() noexcept {
+                    return false;
+                }
+
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+                    return handle.promise().continuation;
+                }
+
+                void await_resume() noexcept {
+                }
+            };
+            return ResumeAwaiter{};
+        }
+
+        void return_value(CommandOutput value) {
+            output = std::move(value);
+        }
+
+        void unhandled_exception() noexcept {
+            exception = std::current_exception();
+        }
+    };
+
+    CommandTask(CommandTask &&other) noexcept : handle(std::exchange(other.handle, nullptr)) {
+    }
+
+    CommandTask &operator=(CommandTask &&other) noexcept {
+        if (this != &other) {
+            Destroy();
+            handle = std::exchange(other.handle, nullptr);
+        }
+        return *this;
+    }
+
+    ~CommandTask() {
+        Destroy();
+    }
+
+    bool await_ready() const noexcept {
+        return handle.done();
+    }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiter) noexcept {
+        handle.promise().continuation = awaiter;
+        return handle;
+    }
+
+    CommandOutput await_resume() {
+        if (handle.promise().exception) {
+            std::rethrow_exception(handle.promise().exception);
+        }
+        return std::move(handle.promise().output);
+    }
+
+  private:
+    explicit CommandTask(std::coroutine_handle<promise_type> handle) noexcept : handle(handle) {
+    }
+
+    void Destroy() noexcept {
+        if (handle) {
+            handle.destroy();
+        }
+    }
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+/**
+ * @brief Runs coroutines, resuming each one when what it awaits is ready: a timer, a file descriptor, or a Post from another thread
+ * @remark A suspended coroutine holds no thread, so a few threads can have thousands of slow commands in flight.
+ *         Call Run from one thread, or from several to share the work between them. Only available in C++20
+ */
+class EventLoop {
+  public:
+    EventLoop() {
+#ifdef EASYCLI_POSIX
+        if (::pipe(wake_pipe) == 0) {
+            for (int fd : wake_pipe) {
+                ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+                ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+            }
+        } else {
+            wake_pipe[0] = wake_pipe[1] = -1;
+        }
+#endif
+    }
+
+    EventLoop(const EventLoop &) = delete;
+    EventLoop &operator=(const EventLoop &) = delete;
+
+    /**
+     * @remark Tasks that haven't finished are leaked, so let Run return first
+     */
+    ~EventLoop() {
+#ifdef EASYCLI_POSIX
+        for (int fd : wake_pipe) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+        }
+#endif
+    }
+
+    /**
+     * @brief Starts a task on this loop and calls on_complete with its output when it finishes. Safe to call from any thread
+     *
+     * @remark Nothing runs until Run is called
+     */
+    void Spawn(CommandTask task, std::function<void(CommandOutput &&)> on_complete) {
+        const std::coroutine_handle<> handle = Drive(std::move(task), std::move(on_complete)).handle;
+        std::lock_guard<std::mutex> lock(mutex);
+        active++;
+        ready.push_back(handle);
+        Wake();
+    }
+
+    /**
+     * @brief Resumes coroutines until every task spawned on this loop has finished
+     *
+     * @remark Waits for timers and file descriptors with a single poll call, made by one of the threads calling Run while
+     *         the others resume coroutines. Rethrows the first exception that escaped a task or its on_complete.
+     *         Calling Run again carries on with the other tasks
+     */
+    void Run() {
+        EventLoop *const previous = std::exchange(current, this);
+        struct Restore {
+            EventLoop *previous;
+            ~Restore() {
+                current = previous;
+            }
+        } restore{previous};
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            if (failure) {
+                std::rethrow_exception(std::exchange(failure, nullptr));
+            }
+            if (active == 0) {
+                return;
+            }
+            if (!ready.empty()) {
+                const std::coroutine_handle<> handle = ready.front();
+                ready.pop_front();
+                lock.unlock();
+                handle.resume();
+                lock.lock();
+            } else if (polling) {
+                idle.wait(lock);
+            } else {
+                Wait(lock);
+            }
+        }
+    }
+
+    /**
+     * @brief Resumes a coroutine on this loop. Safe to call from any thread, e.g. one that finished work a coroutine awaits
+     */
+    void Post(std::coroutine_handle<> handle) {
+        std::lock_guard<std::mutex> lock(mutex);
+        ready.push_back(handle);
+        Wake();
+    }
+
+    /**
+     * @brief Resumes a coroutine on this loop once deadline has passed. Safe to call from any thread
+     */
+    void ResumeAt(std::chrono::steady_clock::time_point deadline, std::coroutine_handle<> handle) {
+        std::lock_guard<std::mutex> lock(mutex);
+        timers.push(Timer{deadline, next_timer++, handle});
+        Wake();
+    }
+
+#ifdef EASYCLI_POSIX
+    /**
+     * @brief Resumes a coroutine on this loop once fd is ready for events (POLLIN or POLLOUT), closed or in error.
+     *        Safe to call from any thread. Only available on POSIX systems
+     */
+    void ResumeWhenReady(int fd, short events, std::coroutine_handle<> handle) {
+        std::lock_guard<std::mutex> lock(mutex);
+        waits.push_back(FdWait{fd, events, handle});
+        Wake();
+    }
+#endif
+
+    /**
+     * @brief Gets the loop the calling thread is running, or nullptr
+     */
+    static EventLoop *Current() {
+        return current;
+    }
+
+  private:
+    // The coroutine behind Spawn, which owns the task until it finishes
+    struct DetachedTask {
+        struct promise_type {
+            DetachedTask get_return_object() noexcept {
+                return DetachedTask{std::coroutine_handle<promise_type>::from_promise(*this)};
+            }
+
+            std::suspend_always initial_suspend() noexcept {
+                return {};
+            }
+
+            std::suspend_never final_suspend() noexcept {
+                return {};
+            }
+
+            void return_void() noexcept {
+            }
+
+            void unhandled_exception() noexcept {
+                std::terminate();
+            }
+        };
+
+        std::coroutine_handle<> handle;
+    };
+
+    struct Timer {
+        std::chrono::steady_clock::time_point deadline;
+        std::uint64_t sequence;
+        std::coroutine_handle<> handle;
+
+        bool operator>(const Timer &other) const {
+            return deadline != other.deadline ? deadline > other.deadline : sequence > other.sequence;
+        }
+    };
+
+    struct FdWait {
+        int fd;
+        short events;
+        std::coroutine_handle<> handle;
+    };
+
+    DetachedTask Drive(CommandTask task, std::function<void(CommandOutput &&)> on_complete) {
+        std::exception_ptr exception;
+        try {
+            CommandOutput output = co_await task;
+            if (on_complete) {
+                on_complete(std::move(output));
+            }
+        } catch (...) {
+            exception = std::current_exception();
+        }
+        // Release the task and the callback while the loop can't be destroyed yet
+        {
+            const CommandTask finished = std::move(task);
+        }
+        on_complete = nullptr;
+        std::lock_guard<std::mutex> lock(mutex);
+        if (exception && !failure) {
+            failure = exception;
+        }
+        if (--active == 0 || failure) {
+            idle.notify_all();
+            Wake();
+        }
+    }
+
+    // Wakes a thread waiting in Run for something to do. Called with the mutex held
+    void Wake() {
+        idle.notify_one();
+#ifdef EASYCLI_POSIX
+        if (polling) {
+            const char byte = 0;
+            (void)!::write(wake_pipe[1], &byte, 1);
+        }
+#else
+        if (polling) {
+            idle.notify_all();
+        }
+#endif
+    }
+
+    // Waits for the next timer, file descriptor or Wake with the mutex released, then queues the coroutines that can go on
+    void Wait(std::unique_lock<std::mutex> &lock) {
+        polling = true;
+#ifdef EASYCLI_POSIX
+        int timeout = -1;
+        if (!timers.empty()) {
+            const auto remaining = std::chrono::ceil<std::chrono::milliseconds>(timers.top().deadline - std::chrono::steady_clock::now());
+            timeout = static_cast<int>(std::clamp<std::chrono::milliseconds::rep>(remaining.count(), 0, 1 << 30));
+        }
+        poll_fds.clear();
+        poll_fds.push_back(pollfd{wake_pipe[0], POLLIN, 0});
+        for (const FdWait &wait : waits) {
+            poll_fds.push_back(pollfd{wait.fd, wait.events, 0});
+        }
+        lock.unlock();
+        const int result = ::poll(poll_fds.data(), static_cast<nfds_t>(poll_fds.size()), timeout);
+        lock.lock();
+        if (result > 0) {
+            char drained[64];
+            while (poll_fds[0].revents != 0 && ::read(wake_pipe[0], drained, sizeof(drained)) > 0) {
+            }
+            // Waits added while polling are after the polled ones and stay
+            std::size_t kept = 0;
+            for (std::size_t i = 0; i < waits.size(); i++) {
+                if (i + 1 < poll_fds.size() && poll_fds[i + 1].revents != 0) {
+                    ready.push_back(waits[i].handle);
+                } else {
+                    waits[kept++] = waits[i];
+                }
+            }
+            waits.resize(kept);
+        }
+#else
+        if (timers.empty()) {
+            idle.wait(lock);
+        } else {
+            idle.wait_until(lock, timers.top().deadline);
+        }
+#endif
+        const auto now = std::chrono::steady_clock::now();
+        while (!timers.empty() && timers.top().deadline <= now) {
+            ready.push_back(timers.top().handle);
+            timers.pop();
+        }
+        polling = false;
+        // Let the idle threads take some of the coroutines, or take over the polling
+        idle.notify_all();
+    }
+
+    static inline thread_local EventLoop *current = nullptr;
+
+    std::mutex mutex;
+    std::condition_variable idle;
+    std::deque<std::coroutine_handle<>> ready;
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> timers;
+    std::uint64_t next_timer = 0;
+    // The number of spawned tasks that haven't finished
+    std::size_t active = 0;
+    // Whether a thread is waiting in Wait
+    bool polling = false;
+    std::exception_ptr failure;
+#ifdef EASYCLI_POSIX
+    std::vector<FdWait> waits;
+    std::vector<pollfd> poll_fds;
+    int wake_pipe[2] = {-1, -1};
+#endif
+};
+
+namespace detail {
+inline EventLoop &CurrentLoop() {
+    EventLoop *loop = EventLoop::Current();
+    if (loop == nullptr) {
+        throw std::logic_error("EasyCLI: awaited outside of an EventLoop");
+    }
+    return *loop;
+}
+
+struct SleepAwaiter {
+    std::chrono::steady_clock::time_point deadline;
+
+    bool await_ready() const {
+        return deadline <= std::chrono::steady_clock::now();
+    }
+
+    void await_suspend(std::coroutine_handle<> handle) const {
+        CurrentLoop().ResumeAt(deadline, handle);
+    }
+
+    void await_resume() const noexcept {
+    }
+};
+
+#ifdef EASYCLI_POSIX
+struct FdAwaiter {
+    int fd;
+    short events;
+
+    bool await_ready() const noexcept {
+        return false;
+    }
+
+    void await_suspend(std::coroutine_handle<> handle) const {
+        CurrentLoop().ResumeWhenReady(fd, events, handle);
+    }
+
+    void await_resume() const noexcept {
+    }
+};
+#endif
+
+template <typename F> class OffloadAwaiter {
+  public:
+    using Result = std::invoke_result_t<F &>;
+
+    OffloadAwaiter(WorkStealingPool &pool, F fn) : pool(pool), fn(std::move(fn)) {
+    }
+
+    bool await_ready() const noexcept {
+        return false;
+    }
+
+    void await_suspend(std::coroutine_handle<> handle) {
+        EventLoop &loop = CurrentLoop();
+        // The coroutine may be resumed on another thread as soon as the task is submitted, so nothing here runs after it
+        pool.Submit([this, &loop, handle] {
+            try {
+                if constexpr (std::is_void_v<Result>) {
+                    fn();
+                } else {
+                    result.emplace(fn());
+                }
+            } catch (...) {
+                exception = std::current_exception();
+            }
+            loop.Post(handle);
+        });
+    }
+
+    Result await_resume() {
+        if (exception) {
+            std::rethrow_exception(exception);
+        }
+        if constexpr (!std::is_void_v<Result>) {
+            return std::move(*result);
+        }
+    }
+
+  private:
+    WorkStealingPool &pool;
+    F fn;
+    std::optional<std::conditional_t<std::is_void_v<Result>, char, Result>> result;
+    std::exception_ptr exception;
+};
+
+/**
+ * @brief A coroutine command, as registered by EasyCLI::RegisterCommand. ExecuteAsync runs it on the loop it is given,
+ *        the other Execute variants run it to completion on a loop of their own
+ */
+struct AsyncCommand {
+    std::function<CommandTask(const CommandArguments &)> fn;
+    // Set by EnableInstrumentation. The latency includes the time the command spent suspended
+    std::shared_ptr<CommandStatsCounters> counters;
+
+    CommandTask Run(const CommandArguments &args) const {
+        const auto start = std::chrono::steady_clock::now();
+        CommandOutput output = co_await fn(args);
+        if (counters) {
+            InstrumentedCommand::Record(*counters, output, args, start);
+        }
+        co_return output;
+    }
+
+    // Runs the command on a loop kept by the thread, which saves creating a loop and its wake pipe per call. A coroutine
+    // command that executes another one synchronously gets a fresh loop, since the thread's loop is busy running it
+    CommandOutput operator()(const CommandArguments &args) const {
+        thread_local EventLoop loop;
+        if (EventLoop::Current() == &loop) {
+            EventLoop nested;
+            return RunOn(nested, args);
+        }
+        return RunOn(loop, args);
+    }
+
+    CommandOutput RunOn(EventLoop &loop, const CommandArguments &args) const {
+        CommandOutput result;
+        loop.Spawn(Run(args), [&result](CommandOutput &&output) { result = std::move(output); });
+        loop.Run();
+        return result;
+    }
+};
+
+// A command started by ExecuteAsync, with copies of the command and its arguments that live until it finishes
+struct AsyncOperation {
+    CommandArguments args;
+    CommandFunction fn;
+};
+
+inline CommandTask RunOperation(std::unique_ptr<AsyncOperation> operation) {
+    if (const AsyncCommand *async = operation->fn.target<AsyncCommand>()) {
+        co_return co_await async->Run(operation->args);
+    }
+    co_return operation->fn(operation->args);
+}
+
+inline CommandTask ReadyTask(CommandOutput output) {
+    co_return output;
+}
+} // namespace detail
+
+/**
+ * @brief Suspends a coroutine command for a while without holding its thread: `co_await SleepFor(std::chrono::milliseconds(10));`
+ */
+inline detail::SleepAwaiter SleepFor(std::chrono::steady_clock::duration duration) {
+    return detail::SleepAwaiter{std::chrono::steady_clock::now() + duration};
+}
+
+#ifdef EASYCLI_POSIX
+/**
+ * @brief Suspends a coroutine command until fd has data to read, like the output pipe of a child process. Only available on POSIX systems
+ */
+inline detail::FdAwaiter WaitReadable(int fd) {
+    return detail::FdAwaiter{fd, POLLIN};
+}
+
+/**
+ * @brief Suspends a coroutine command until fd can be written to. Only available on POSIX systems
+ */
+inline detail::FdAwaiter WaitWritable(int fd) {
+    return detail::FdAwaiter{fd, POLLOUT};
+}
+#endif
+
+/**
+ * @brief Runs fn on a thread pool and suspends the coroutine command until it returns, with its result: `std::string text = co_await Offload(pool, read_file);`
+ *
+ * @remark For blocking work that can't be awaited, like reading a regular file, so it holds a pool thread instead of a loop thread.
+ *         An exception thrown by fn is rethrown by the co_await
+ */
+template <typename F> detail::OffloadAwaiter<std::decay_t<F>> Offload(WorkStealingPool &pool, F &&fn) {
+    return detail::OffloadAwaiter<std::decay_t<F>>(pool, std::forward<F>(fn));
+}
+#endif
+
+namespace detail {
+/**
+ * @brief A read-only view of a whole file. On POSIX systems the file is memory-mapped, elsewhere it is read into memory
+ */
+class MappedFile {
+  public:
+    explicit MappedFile(const std::string &path) {
+#ifdef EASYCLI_POSIX
+        const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            throw std::runtime_error("Can't open \"" + path + "\": " + std::strerror(errno));
+        }
+        struct stat info;
+        if (::fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+            ::close(fd);
+            throw std::runtime_error("\"" + path + "\" is not a regular file");
+        }
+        size = static_cast<std::size_t>(info.st_size);
+        if (size > 0) {
+            void *mapping = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping == MAP_FAILED) {
+                const int error = errno;
+                ::close(fd);
+                throw std::runtime_error("Can't map \"" + path + "\": " + std::strerror(error));
+            }
+            data = static_cast<const char *>(mapping);
+            ::posix_madvise(mapping, size, POSIX_MADV_SEQUENTIAL);
+        }
+        ::close(fd);
+#else
+        std::ifstream file(path, std::ios::binary);
+        if (!file) {
+            throw std::runtime_error("Can't open \"" + path + "\"");
+        }
+        contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        data = contents.data();
+        size = contents.size();
+#endif
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile() {
+#ifdef EASYCLI_POSIX
+        if (data != nullptr) {
+            ::munmap(const_cast<char *>(data), size);
+        }
+#endif
+    }
+
+    std::string_view View() const {
+        return std::string_view(data, size);
+    }
+
+  private:
+    const char *data = nullptr;
+    std::size_t size = 0;
+#ifndef EASYCLI_POSIX
+    std::string contents;
+#endif
+};
+} // namespace detail
+
+namespace detail {
+/**
+ * @brief A radix trie of command names, for prefix lookups: unique-prefix abbreviations and completion
+ * @remark Nodes live in one vector and link to their first child and next sibling by index. Their labels are slices of one
+ *         string, so the trie costs a few allocations in total. Siblings are kept sorted, so names come out sorted
+ */
+class RadixTrie {
+  public:
+    RadixTrie() : nodes(1) {
+    }
+
+    /**
+     * @brief Adds a name
+     *
+     * @return false if the name was already there
+     */
+    bool Insert(std::string_view name) {
+        std::string path;
+        const std::uint32_t existing = FindPrefix(name, path);
+        if (existing != kNone && path.size() == name.size() && nodes[existing].terminal) {
+            return false;
+        }
+        std::uint32_t node = 0;
+        nodes[0].names++;
+        for (;;) {
+            if (name.empty()) {
+                nodes[node].terminal = true;
+                return true;
+            }
+            // Find the child that starts like name, or where to insert one
+            std::uint32_t previous = kNone;
+            std::uint32_t child = nodes[node].first_child;
+            while (child != kNone && Byte(Label(child)[0]) < Byte(name[0])) {
+                previous = child;
+                child = nodes[child].next_sibling;
+            }
+            if (child == kNone || Label(child)[0] != name[0]) {
+                const std::uint32_t leaf = AddNode(name);
+                nodes[leaf].terminal = true;
+                nodes[leaf].names = 1;
+                nodes[leaf].next_sibling = child;
+                (previous == kNone ? nodes[node].first_child : nodes[previous].next_sibling) = leaf;
+                return true;
+            }
+            const std::string_view label = Label(child);
+            const std::size_t common = static_cast<std::size_t>(std::mismatch(label.begin(), label.end(), name.begin(), name.end()).first - label.begin());
+            if (common < label.size()) {
+                Split(child, common);
+            }
+            nodes[child].names++;
+            node = child;
+            name.remove_prefix(common);
+        }
+    }
+
+    /**
+     * @brief Returns the only name that starts with prefix, or an empty string if there are none or several
+     */
+    std::string UniqueCompletion(std::string_view prefix) const {
+        std::string path;
+        std::uint32_t node = FindPrefix(prefix, path);
+        if (node == kNone || nodes[node].names != 1) {
+            return std::string();
+        }
+        while (!nodes[node].terminal) {
+            node = nodes[node].first_child;
+            path += Label(node);
+        }
+        return path;
+    }
+
+    /**
+     * @brief Appends every name that starts with prefix to out, sorted
+     * @remark O(prefix + results): only the subtree under the prefix is visited
+     */
+    void Complete(std::string_view prefix, std::vector<std::string> &out) const {
+        std::string path;
+        const std::uint32_t node = FindPrefix(prefix, path);
+        if (node != kNone) {
+            Collect(node, path, out);
+        }
+    }
+
+    std::size_t size() const {
+        return nodes[0].names;
+    }
+
+    /**
+     * @brief The memory the trie uses, in bytes
+     */
+    std::size_t MemoryUsage() const {
+        return sizeof(*this) + nodes.capacity() * sizeof(Node) + labels.capacity();
+    }
+
+  private:
+    static constexpr std::uint32_t kNone = static_cast<std::uint32_t>(-1);
+
+    struct Node {
+        std::uint32_t label_offset = 0;
+        std::uint32_t label_length = 0;
+        std::uint32_t first_child = kNone;
+        std::uint32_t next_sibling = kNone;
+        // The number of names in this subtree
+        std::uint32_t names = 0;
+        bool terminal = false;
+    };
+
+    static unsigned char Byte(char c) {
+        return static_cast<unsigned char>(c);
+    }
+
+    std::string_view Label(std::uint32_t node) const {
+        return std::string_view(labels).substr(nodes[node].label_offset, nodes[node].label_length);
+    }
+
+    std::uint32_t AddNode(std::string_view label) {
+        Node node;
+        node.label_offset = static_cast<std::uint32_t>(labels.size());
+        node.label_length = static_cast<std::uint32_t>(label.size());
+        labels += label;
+        nodes.push_back(node);
+        return static_cast<std::uint32_t>(nodes.size() - 1);
+    }
+
+    // Cuts the label of node after `at` bytes, moving the rest of it into a new only child
+    void Split(std::uint32_t node, std::size_t at) {
+        Node tail = nodes[node];
+        tail.label_offset += static_cast<std::uint32_t>(at);
+        tail.label_length -= static_cast<std::uint32_t>(at);
+        tail.next_sibling = kNone;
+        nodes.push_back(tail);
+        nodes[node].label_length = static_cast<std::uint32_t>(at);
+        nodes[node].first_child = static_cast<std::uint32_t>(nodes.size() - 1);
+        nodes[node].terminal = false;
+    }
+
+    // Finds the highest node whose subtree holds every name starting with prefix. path is set to the name of that node
+    std::uint32_t FindPrefix(std::string_view prefix, std::string &path) const {
+        std::uint32_t node = 0;
+        path.clear();
+        while (!prefix.empty()) {
+            std::uint32_t child = nodes[node].first_child;
+            while (child != kNone && Label(child)[0] != prefix[0]) {
+                child = nodes[child].next_sibling;
+            }
+            if (child == kNone) {
+                return kNone;
+            }
+            const std::string_view label = Label(child);
+            const std::size_t length = std::min(label.size(), prefix.size());
+            if (label.substr(0, length) != prefix.substr(0, length)) {
+                return kNone;
+            }
+            path += label;
+            prefix.remove_prefix(length);
+            node = child;
+        }
+        return node;
+    }
+
+    void Collect(std::uint32_t node, std::string &path, std::vector<std::string> &out) const {
+        if (nodes[node].terminal) {
+            out.push_back(path);
+        }
+        for (std::uint32_t child = nodes[node].first_child; child != kNone; child = nodes[child].next_sibling) {
+            const std::size_t length = path.size();
+            path += Label(child);
+            Collect(child, path, out);
+            path.resize(length);
+        }
+    }
+
+    std::vector<Node> nodes;
+    std::string labels;
+};
+
+/**
+ * @brief Computes Levenshtein distances from one pattern to many texts
+ * @remark Uses Myers' bit-parallel algorithm, in Hyyrö's formulation for the distance between whole strings: one column of the
+ *         dynamic programming matrix is a pair of 64-bit delta vectors, so each text character costs a few word operations.
+ *         Patterns longer than 64 characters fall back to the classic two-row algorithm
+ */
+class EditDistance {
+  public:
+    explicit EditDistance(std::string_view pattern) : pattern(pattern) {
+        if (pattern.size() <= 64) {
+            for (std::size_t i = 0; i < pattern.size(); i++) {
+                peq[static_cast<unsigned char>(pattern[i])] |= std::uint64_t{1} << i;
+            }
+        }
+    }
+
+    std::size_t To(std::string_view text) const {
+        const std::size_t m = pattern.size();
+        if (m == 0) {
+            return text.size();
+        }
+        if (m > 64) {
+            return ToSlow(text);
+        }
+        const std::uint64_t last = std::uint64_t{1} << (m - 1);
+        std::uint64_t pv = ~std::uint64_t{0};
+        std::uint64_t mv = 0;
+        std::size_t score = m;
+        for (char c : text) {
+            const std::uint64_t eq = peq[static_cast<unsigned char>(c)];
+            const std::uint64_t xv = eq | mv;
+            const std::uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+            std::uint64_t ph = mv | ~(xh | pv);
+            std::uint64_t mh = pv & xh;
+            if (ph & last) {
+                score++;
+            } else if (mh & last) {
+                score--;
+            }
+            // Row 0 of the matrix counts up, so a +1 delta is shifted in
+            ph = (ph << 1) | 1;
+            mh <<= 1;
+            pv = mh | ~(xv | ph);
+            mv = ph & xv;
+        }
+        return score;
+    }
+
+  private:
+    std::size_t ToSlow(std::string_view text) const {
+        std::vector<std::size_t> row(pattern.size() + 1);
+        for (std::size_t i = 0; i < row.size(); i++) {
+            row[i] = i;
+        }
+        for (std::size_t j = 0; j < text.size(); j++) {
+            std::size_t diagonal = row[0];
+            row[0] = j + 1;
+            for (std::size_t i = 1; i < row.size(); i++) {
+                const std::size_t above = row[i];
+                row[i] = std::min({row[i] + 1, row[i - 1] + 1, diagonal + (pattern[i - 1] == text[j] ? 0 : 1)});
+                diagonal = above;
+            }
+        }
+        return row.back();
+    }
+
+    std::string_view pattern;
+    std::array<std::uint64_t, 256> peq{};
+};
+
+inline int PopCount(std::uint64_t bits) {
+#if defined(__GNUC__)
+    return __builtin_popcountll(bits);
+#else
+    int count = 0;
+    for (; bits != 0; bits &= bits - 1) {
+        count++;
+    }
+    return count;
+#endif
+}
+
+/**
+ * @brief An index of command names, to find the names within an edit distance of a misspelled one
+ * @remark Each name is stored with its length and a 64-bit mask of the characters in it. A name is only within distance k of a
+ *         word if their lengths differ by at most k, and if neither has more than k distinct characters the other lacks. So a pass
+ *         over these packed signatures rejects most names with a few integer operations, and only the rest get an edit distance
+ */
+class SpellingIndex {
+  public:
+    void Insert(std::string_view name) {
+        entries.push_back(Entry{Mask(name), static_cast<std::uint32_t>(names.size()), static_cast<std::uint32_t>(name.size())});
+        names += name;
+    }
+
+    /**
+     * @brief Finds the names within max_distance of word
+     *
+     * @return Up to max_results names with their distances, closest first, ties sorted by name
+     */
+    std::vector<std::pair<std::size_t, std::string>> Search(std::string_view word, std::size_t max_distance, std::size_t max_results) const {
+        std::vector<std::pair<std::size_t, std::string>> found;
+        if (max_results == 0) {
+            return found;
+        }
+        const EditDistance distance(word);
+        const std::uint64_t mask = Mask(word);
+        const int max_missing = static_cast<int>(std::min<std::size_t>(max_distance, 64));
+        for (const Entry &entry : entries) {
+            const std::size_t length_difference = entry.length > word.size() ? entry.length - word.size() : word.size() - entry.length;
+            if (length_difference > max_distance || PopCount(mask & ~entry.mask) > max_missing || PopCount(entry.mask & ~mask) > max_missing) {
+                continue;
+            }
+            const std::string_view name = std::string_view(names).substr(entry.offset, entry.length);
+            const std::size_t d = distance.To(name);
+            if (d <= max_distance) {
+                found.emplace_back(d, std::string(name));
+            }
+        }
+        std::sort(found.begin(), found.end());
+        if (found.size() > max_results) {
+            found.resize(max_results);
+        }
+        return found;
+    }
+
+    std::size_t MemoryUsage() const {
+        return sizeof(*this) + entries.capacity() * sizeof(Entry) + names.capacity();
+    }
+
+  private:
+    struct Entry {
+        std::uint64_t mask;
+        std::uint32_t offset;
+        std::uint32_t length;
+    };
+
+    // Characters that share their low 6 bits share a bit, which only makes the filter let more names through
+    static std::uint64_t Mask(std::string_view name) {
+        std::uint64_t mask = 0;
+        for (char c : name) {
+            mask |= std::uint64_t{1} << (static_cast<unsigned char>(c) & 63);
+        }
+        return mask;
+    }
+
+    std::vector<Entry> entries;
+    std::string names;
+};
+
+// The command names of an EasyCLI, kept apart from the registry so prefix and spelling lookups don't touch the hash map
+struct CommandIndex {
+    std::mutex mutex;
+    RadixTrie trie;
+    SpellingIndex spelling;
+
+    void Insert(std::string_view name) {
+        if (trie.Insert(name)) {
+            spelling.Insert(name);
+        }
+    }
+
+    std::size_t MemoryUsage() const {
+        return trie.MemoryUsage() + spelling.MemoryUsage();
+    }
+};
+} // namespace detail
+
+class EasyCLI;
+class PreparedCommand;
+
+namespace detail {
+/**
+ * @brief The command registered by EasyCLI::RegisterGroup. Dispatch descends into the group without calling it
+ * @remark Calling it with arguments already parsed for it, e.g. through GetCommands, runs the subcommand named by the first argument
+ */
+struct CommandGroup {
+    std::shared_ptr<EasyCLI> cli;
+
+    CommandOutput operator()(const CommandArguments &args) const;
+    CommandOutput operator()(const CommandArguments &args, OutputSink &sink) const;
+};
+} // namespace detail
+
+/**
+ * @brief  A class that makes it easy to create a CLI
+ * @remark By default this class is not thread-safe: commands can be executed from many threads at once,
+ *         but not while a command is being registered. Call EnableConcurrentAccess to allow that too
+ */
+class EasyCLI {
+  public:
+    EasyCLI() {
+    }
+
+    EasyCLI(const CommandMap &commands) : commands(commands) {
+        for (const auto &command : commands) {
+            index->Insert(command.first);
+        }
+    }
+
+    EasyCLI(const EasyCLI &other) {
+        *this = other;
+    }
+
+    EasyCLI &operator=(const EasyCLI &other) {
+        if (this != &other) {
+            std::unique_lock<std::mutex> lock;
+            if (other.concurrent) {
+                lock = std::unique_lock<std::mutex>(other.concurrent->writer);
+            }
+            commands = other.commands;
+            path = other.path;
+            abbreviations = other.abbreviations;
+            suggestions = other.suggestions;
+            suggestion_distance = other.suggestion_distance;
+            index = std::make_unique<detail::CommandIndex>();
+            for (const auto &command : commands) {
+                index->Insert(command.first);
+            }
+            concurrent = other.concurrent ? std::make_unique<detail::SnapshotRegistry>(commands, NamesSnapshot()) : nullptr;
+            // Instrumented commands keep recording into the counters they were registered with, so copies share them
+            stats = other.stats;
+            detail::registry_generation.fetch_add(1, std::memory_order_release);
+        }
+        return *this;
+    }
+
+    EasyCLI(EasyCLI &&) = default;
+    EasyCLI &operator=(EasyCLI &&) = default;
+
+    /**
+     * @brief Makes it safe to register commands while other threads execute them
+     *
+     * @remark Executing stays lock-free: each call reads an immutable snapshot of the registry. Registering copies the registry
+     *         and publishes the copy, so it becomes O(n) in the number of commands. Call this before sharing the EasyCLI between threads
+     */
+    void EnableConcurrentAccess() {
+        if (!concurrent) {
+            concurrent = std::make_unique<detail::SnapshotRegistry>(commands, NamesSnapshot());
+        }
+        ForEachGroup([](EasyCLI &group) { group.EnableConcurrentAccess(); });
+    }
+
+    /**
+     * @brief Starts recording call counts, success and failure counts and a latency histogram for every command,
+     *        and registers a built-in `stats` command that prints them
+     *
+     * @remark Each command is wrapped when it is registered, so dispatch does no extra lookup. Counters are per-thread stripes
+     *         updated with relaxed atomics. Commands registered before this call are wrapped too
+     * @remark The commands of a group are only counted if this is called on the group, and its `stats` command prints them
+     */
+    void EnableInstrumentation() {
+        if (stats) {
+            return;
+        }
+        stats = std::make_shared<detail::StatsTable>();
+        std::unique_lock<std::mutex> lock;
+        if (concurrent) {
+            lock = std::unique_lock<std::mutex>(concurrent->writer);
+        }
+        for (auto &command : commands) {
+            command.second = Instrument(command.first, std::move(command.second));
+        }
+        if (commands.find("stats") == commands.end()) {
+            std::shared_ptr<detail::StatsTable> table = stats;
+            commands.emplace("stats", [table](const CommandArguments &) { return CommandOutput{detail::FormatStats(table->Snapshot()), true}; });
+            if (index) {
+                std::lock_guard<std::mutex> index_lock(index->mutex);
+                index->Insert("stats");
+            }
+        }
+        if (concurrent) {
+            concurrent->Publish(commands, NamesSnapshot());
+        }
+        detail::registry_generation.fetch_add(1, std::memory_order_release);
+    }
+
+    /**
+     * @brief Lets users type any unique prefix of a command name instead of the whole name, like `mul 6 7` for `multiply 6 7`
+     *
+     * @remark An exact name always wins, and a prefix shared by several commands is an unknown command. The prefix is only
+     *         looked up when the name isn't registered, so dispatching full names costs nothing more. In concurrent mode the
+     *         names are published with each registry snapshot, so abbreviations resolve without locking. Call this before
+     *         sharing the EasyCLI between threads
+     */
+    void EnableAbbreviations() {
+        if (!abbreviations && concurrent) {
+            abbreviations = true;
+            std::lock_guard<std::mutex> lock(concurrent->writer);
+            concurrent->Publish(commands, NamesSnapshot());
+        }
+        abbreviations = true;
+        ForEachGroup([](EasyCLI &group) { group.EnableAbbreviations(); });
+    }
+
+    /**
+     * @brief Makes the error for an unknown command suggest the closest command names, like
+     *        `Unknown command: "stauts". Did you mean "status"?`
+     *
+     * @param max_results How many names to suggest at most
+     * @param max_distance How many edits away a suggestion may be. Names shorter than twice this get proportionally fewer
+     * @remark The suggestions are only computed for unknown commands, so known commands cost nothing more. Call this before
+     *         sharing the EasyCLI between threads
+     */
+    void EnableSuggestions(std::size_t max_results = 3, std::size_t max_distance = 2) {
+        suggestions = max_results;
+        suggestion_distance = max_distance;
+        ForEachGroup([=](EasyCLI &group) { group.EnableSuggestions(max_results, max_distance); });
+    }
+
+    /**
+     * @brief Gets a snapshot of the statistics of every instrumented command, sorted by name
+     *
+     * @return The statistics, or an empty vector if EnableInstrumentation wasn't called
+     */
+    std::vector<CommandStats> GetStats() const {
+        return stats ? stats->Snapshot() : std::vector<CommandStats>();
+    }
+
+    /**
+     * @brief Sets every statistic back to 0
+     */
+    void ResetStats() {
+        if (stats) {
+            stats->Reset();
+        }
+    }
+
+    /**
+     * @brief Adds a command to the list of commands
+     *
+     * @param name the name of the command to add. it should not contain spaces or the command will be unreachable by user input
+     * @param fn the callback function to call when the command is executed. Must be of type `std::function<CommandOutput(const CommandArguments &)>`
+     */
+    void RegisterCommand(const std::string &name, CommandFunction fn) {
+        StoreCommand(name, std::move(fn));
+    }
+
+    /**
+     * @brief Adds a command to the list of commands
+     *
+     * @param name the name of the command to add. it should not contain spaces or the command will be unreachable by user input
+     * @param fn the callback function to call when the command is executed. Must be of type `CommandOutput (*)(const CommandArguments &)`
+     */
+    void RegisterCommand(const std::string &name, CommandOutput (*fn)(const CommandArguments &)) {
+        StoreCommand(name, fn);
+    }
+
+    /**
+     * @brief Adds a command to the list of commands
+     *
+     * @tparam T the type of the callback function to call when the command is executed. Must be convertible to `CommandOutput (*)(const CommandArguments &)`,
+     *           other callables (like capturing lambdas) go through the CommandFunction overload
+     * @param name the name of the command to add. it should not contain spaces or the command will be unreachable by user input
+     * @param c the callback function to call when the command is executed. Must be of type `CommandOutput (*)(const CommandArguments &)`
+     */
+    template <typename T, typename = std::enable_if_t<std::is_convertible_v<T, CommandOutput (*)(const CommandArguments &)>>>
+    void RegisterCommand(const std::string &name, T c) {
+        StoreCommand(name, BINDFN(c));
+    }
+
+    /**
+     * @brief Adds a command that declares the flags it understands
+     *
+     * @remark Each declared flag is numbered in order, and `args.flags_contains(i)` tests whether the i-th one was given
+     *         with a single bit test. `args.flags_contains("name")` also becomes O(1) for declared flags. Undeclared flags
+     *         are still passed in `args.flags`
+     * @param name the name of the command to add. it should not contain spaces or the command will be unreachable by user input
+     * @param fn the callback function to call when the command is executed
+     * @param known_flags the flags the command understands, without their leading '-'. Throws std::invalid_argument on a duplicate
+     */
+    void RegisterCommand(const std::string &name, CommandFunction fn, FlagSet known_flags) {
+        fn.SetKnownFlags(std::make_shared<const FlagSet>(std::move(known_flags)));
+        StoreCommand(name, std::move(fn));
+    }
+
+#ifdef EASYCLI_COROUTINES
+    /**
+     * @brief Adds a coroutine command: a callable taking `const CommandArguments &` and returning CommandTask
+     *
+     * @remark ExecuteAsync runs it on an event loop, where it can co_await SleepFor, WaitReadable, Offload or other tasks
+     *         without holding a thread. The other Execute variants run it to completion on a loop of their own. Only available in C++20
+     * @param name the name of the command to add. it should not contain spaces or the command will be unreachable by user input
+     * @param fn the coroutine. Its arguments, and the captures of a lambda, stay valid until it finishes
+     */
+    template <typename F, std::enable_if_t<std::is_invocable_r_v<CommandTask, const F &, const CommandArguments &>, int> = 0>
+    void RegisterCommand(const std::string &name, F fn) {
+        StoreCommand(name, detail::AsyncCommand{std::move(fn), nullptr});
+    }
+#endif
+
+    /**
+     * @brief Adds a group of subcommands, like `cluster` in `cluster node drain n1`, and returns the EasyCLI that holds them
+     *
+     * @remark Register the subcommands, or nested groups, on the returned EasyCLI. Every Execute variant walks the tokens of the
+     *         input once: each group name picks the table the next token is looked up in, and only the tokens after the command
+     *         are parsed into its arguments. So `drain` gets `args.command == "drain"` and `args.arguments == {"n1"}`, as if it had
+     *         been run alone
+     * @remark Registering a group that exists returns it, even from concurrent calls in concurrent mode. A new group starts with
+     *         the abbreviation, suggestion and concurrency settings of this EasyCLI, and enabling them here later enables them on
+     *         the groups too. Copies of this EasyCLI share its groups
+     * @remark Throws std::invalid_argument if a command that isn't a group has that name. Registering a command over a group
+     *         replaces the group, and ends the life of the returned EasyCLI once no copy of this one holds it
+     * @param name the name of the group. it should not contain spaces or the group will be unreachable by user input
+     * @return EasyCLI& The group, which lives as long as it is registered here
+     */
+    EasyCLI &RegisterGroup(const std::string &name) {
+        // The lookup and the insert happen under one writer lock, so two callers can't each create the group
+        std::unique_lock<std::mutex> lock;
+        if (concurrent) {
+            lock = std::unique_lock<std::mutex>(concurrent->writer);
+        }
+        if (const CommandFunction *fn = detail::FindCommand(commands, name)) {
+            if (const detail::CommandGroup *group = fn->target<detail::CommandGroup>()) {
+                return *group->cli;
+            }
+            throw std::invalid_argument("\"" + name + "\" is already registered as a command");
+        }
+        std::shared_ptr<EasyCLI> group = std::make_shared<EasyCLI>();
+        group->path = path.empty() ? name : path + ' ' + name;
+        group->abbreviations = abbreviations;
+        group->suggestions = suggestions;
+        group->suggestion_distance = suggestion_distance;
+        if (concurrent) {
+            group->EnableConcurrentAccess();
+        }
+        EasyCLI &result = *group;
+        StoreCommandLocked(name, detail::CommandGroup{std::move(group)});
+        return result;
+    }
+
+    /**
+     * @brief Executes a command from user input and returns the output
+     *
+     * @remark This is the most basic way to execute a command, but it's not the most convenient.
+     * @remark Like every Execute variant, it parses into a CommandArguments reused by the calling thread, so once warmed up
+     *         it makes no allocation besides what the command itself allocates
+     * @param input The user input to parse and execute
+     * @return CommandOutput The output of the command or an error output if the command failed.
+     */
+    CommandOutput Execute(const std::string &input) {
+        return Dispatch(Tokenizer(input), CallOrUnknown);
+    }
+
+    /**
+     * @brief Executes a command from user input and sends error output to a stream (std::cerr by default)
+     *
+     * @param input The user input to parse and execute
+     * @param error_stream The stream to send error output to. std::cerr by default
+     * @return CommandOutput The output of the command or an error output if the command failed.
+     */
+    CommandOutput ExecuteWithErrStream(const std::string &input, std::ostream &error_stream = std::cerr) {
+        CommandOutput out = Dispatch(Tokenizer(input), CallOrUnknown);
+        if (!out.success) {
+            error_stream << out.out;
+        }
+        return out;
+    }
+
+    /**
+     * @brief Executes a command from user input and sends output to a stream (std::cout by default) and error output to another stream (std::cerr by default)
+     *
+     * @param input The user input to parse and execute
+     * @param output_stream The stream to send output to. std::cout by default
+     * @param error_stream The stream to send error output to. std::cerr by default
+     * @return CommandOutput the output of the command or an error output if the command failed.
+     */
+    CommandOutput ExecuteIntoStream(const std::string &input, std::ostream &output_stream = std::cout, std::ostream &error_stream = std::cerr) {
+        return Dispatch(Tokenizer(input), [&](const CommandFunction *fn, CommandArguments &args, const EasyCLI &owner) {
+            if (fn == nullptr) {
+                return owner.Unknown(args.command);
+            }
+            StreamOutputSink sink(output_stream);
+            CommandOutput out = Call(*fn, args, sink);
+            if (out.success) {
+                output_stream << std::endl;
+            } else {
+                error_stream << out.out << std::endl;
+            }
+            return out;
+        });
+    }
+
+    /**
+     * @brief Executes a command from user input, writing its output to a sink as it is produced, followed by a newline on success
+     *
+     * @remark Streaming commands write to the sink directly, so their output never has to be held in memory whole
+     * @remark Unlike ExecuteIntoStream, this never flushes. To send the output of many commands to a file or a pipe,
+     *         pass the same BufferedOutputSink to every call so it goes out in a few large writes
+     * @param input The user input to parse and execute
+     * @param sink The sink to send output to
+     * @param error_stream The stream to send error output to. std::cerr by default
+     * @return CommandOutput The success of the command, and the error output if it failed.
+     */
+    CommandOutput ExecuteIntoSink(const std::string &input, OutputSink &sink, std::ostream &error_stream = std::cerr) {
+        CommandOutput out = Dispatch(Tokenizer(input), [&sink](const CommandFunction *fn, CommandArguments &args, const EasyCLI &owner) {
+            return fn ? Call(*fn, args, sink) : owner.Unknown(args.command);
+        });
+        if (out.success) {
+            sink.Write("\n");
+        } else {
+            error_stream << out.out << std::endl;
+        }
+        return out;
+    }
+
+    /**
+     * @brief Execute a command without returning the output
+     *
+     * @param input The user input to parse and execute
+     */
+    void ExecuteVoid(const std::string &input) {
+        Dispatch(Tokenizer(input), [](const CommandFunction *fn, CommandArguments &args, const EasyCLI &) {
+            if (fn != nullptr) {
+                Call(*fn, args);
+            }
+        });
+    }
+
+    /**
+     * @brief Execute a command and modifies a string that is passed by reference with the output of the command
+     *
+     * @param input The user input to parse and execute
+     * @param output The string to modify with the output of the command
+     */
+    void ExecuteVoidIntoString(const std::string &input, std::string &output) {
+        Dispatch(Tokenizer(input), [&output](const CommandFunction *fn, CommandArguments &args, const EasyCLI &) {
+            if (fn != nullptr) {
+                output = Call(*fn, args).out;
+            }
+        });
+    }
+
+    /**
+     * @brief Executes a command from user input and sends error output to a stream (std::cerr by default)
+     *
+     * @param input The user input to parse and execute
+     * @param error_stream The stream to send error output to. std::cerr by default
+     */
+    void ExecuteVoidWithErrStream(const std::string &input, std::ostream &error_stream = std::cerr) {
+        CommandOutput out = Dispatch(Tokenizer(input), CallOrUnknown);
+        if (!out.success) {
+            error_stream << out.out << std::endl;
+        }
+    }
+
+    /**
+     * @brief Executes a command from user input and sends output to a stream (std::cout by default) and error output to another stream (std::cerr by default)
+     *
+     * @param input The user input to parse and execute
+     * @param output_stream The stream to send output to. std::cout by default
+     * @param error_stream The stream to send error output to. std::cerr by default
+     */
+    void ExecuteVoidIntoStream(const std::string &input, std::ostream &output_stream = std::cout, std::ostream &error_stream = std::cerr) {
+        Dispatch(Tokenizer(input), [&](const CommandFunction *fn, CommandArguments &args, const EasyCLI &) {
+            if (fn == nullptr) {
+                return;
+            }
+            StreamOutputSink sink(output_stream);
+            CommandOutput output = Call(*fn, args, sink);
+            if (output.success) {
+                output_stream << std::endl;
+            } else {
+                error_stream << output.out << std::endl;
+            }
+        });
+    }
+
+    /**
+     * @brief Executes a command that should finish within timeout, and that can be cancelled from another thread
+     *
+     * @remark The command sees its deadline and the token in args, and should return once args.stop_requested() is true.
+     *         Whatever it returns then, the output is a timeout or cancellation error, which instrumented commands count as a failure,
+     *         and as a timeout in their statistics. A command that doesn't check can only be abandoned with the pool overload
+     * @param input The user input to parse and execute
+     * @param timeout How long the command may run
+     * @param token A token to cancel the command with. By default one that is never cancelled
+     * @return CommandOutput The output of the command or an error output if the command failed, timed out or was cancelled
+     */
+    CommandOutput ExecuteWithTimeout(const std::string &input, std::chrono::nanoseconds timeout, CancellationToken token = CancellationToken()) {
+        const std::chrono::steady_clock::time_point deadline = detail::DeadlineAfter(timeout);
+        return Dispatch(Tokenizer(input), [&](const CommandFunction *fn, CommandArguments &args, const EasyCLI &owner) {
+            if (fn == nullptr) {
+                return owner.Unknown(args.command);
+            }
+            args.deadline = deadline;
+            args.cancellation = std::move(token);
+            return detail::CheckInterrupted(Call(*fn, args), args);
+        });
+    }
+
+    /**
+     * @brief Same as ExecuteWithTimeout, but runs the command on pool and returns by the deadline even if the command hasn't,
+     *        so a command that never checks args.stop_requested() can't hold up the caller
+     *
+     * @remark An abandoned command keeps running on the pool with its own copy of its arguments, and its output is dropped.
+     *         Whatever it uses must outlive it, and it holds a pool thread until it returns, so size the pool for that.
+     *         A command still queued when its deadline passes, or when it is cancelled, is never called
+     * @remark An exception thrown by the command is rethrown here, unless the call has already timed out
+     * @remark Cancelling token makes this return within a few milliseconds, whether or not the command checks it
+     * @remark Called from a worker of pool without a deadline, this runs queued tasks while it waits, so it can't deadlock the pool.
+     *         It may then run the command itself, and only the command checking token can end it early.
+     *         With a deadline it only waits, so called from a task while every other worker is busy, it times out
+     * @param input The user input to parse and execute
+     * @param timeout How long to wait for the command
+     * @param pool The thread pool to run the command on
+     * @param token A token to cancel the command with. By default one that is never cancelled
+     * @return CommandOutput The output of the command or an error output if the command failed, timed out or was cancelled
+     */
+    CommandOutput ExecuteWithTimeout(const std::string &input, std::chrono::nanoseconds timeout, WorkStealingPool &pool, CancellationToken token = CancellationToken()) {
+        struct WatchedCall {
+            CommandArguments args;
+            CommandFunction fn;
+            std::mutex mutex;
+            std::condition_variable done_condition;
+            CommandOutput out;
+            std::exception_ptr error;
+            std::chrono::steady_clock::time_point submitted;
+            bool done = false;
+        };
+        const std::chrono::steady_clock::time_point deadline = detail::DeadlineAfter(timeout);
+        std::shared_ptr<WatchedCall> call;
+        CommandOutput unknown;
+        Dispatch(Tokenizer(input), [&](const CommandFunction *fn, CommandArguments &args, const EasyCLI &owner) {
+            if (fn == nullptr) {
+                unknown = owner.Unknown(args.command);
+                return;
+            }
+            call = std::make_shared<WatchedCall>();
+            call->args = args;
+            call->fn = *fn;
+        });
+        if (!call) {
+            return unknown;
+        }
+        call->args.deadline = deadline;
+        call->args.cancellation = std::move(token);
+        call->submitted = std::chrono::steady_clock::now();
+        pool.Submit([call] {
+            CommandOutput out;
+            std::exception_ptr error;
+            // The caller has already been told the command timed out or was cancelled, so it must not run after all
+            if (call->args.stop_requested()) {
+                RecordSkipped(call->fn, call->args, call->submitted);
+            } else {
+                try {
+                    out = Call(call->fn, call->args);
+                } catch (...) {
+                    error = std::current_exception();
+                }
+            }
+            std::lock_guard<std::mutex> lock(call->mutex);
+            call->out = std::move(out);
+            call->error = std::move(error);
+            call->done = true;
+            call->done_condition.notify_all();
+        });
+        // Cancelling a token notifies nobody, so while the token can be cancelled the wait wakes up regularly to check it
+        const bool cancellable = call->args.cancellation.CanBeCancelled();
+        std::unique_lock<std::mutex> lock(call->mutex);
+        while (!call->done) {
+            if (call->args.cancellation.IsCancelled()) {
+                return CommandOutput{"Command \"" + call->args.command + "\" was cancelled", false};
+            }
+            const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            if (now >= deadline) {
+                return CommandOutput{"Command \"" + call->args.command + "\" timed out", false};
+            }
+            if (deadline == std::chrono::steady_clock::time_point::max() && pool.OnWorkerThread()) {
+                lock.unlock();
+                const bool ran = pool.TryRunOne();
+                lock.lock();
+                if (ran) {
+                    continue;
+                }
+            }
+            if (cancellable) {
+                call->done_condition.wait_until(lock, std::min(deadline, now + std::chrono::milliseconds(5)));
+            } else if (deadline == std::chrono::steady_clock::time_point::max()) {
+                call->done_condition.wait(lock);
+            } else {
+                call->done_condition.wait_until(lock, deadline);
+            }
+        }
+        if (call->error) {
+            std::rethrow_exception(call->error);
+        }
+        return detail::CheckInterrupted(std::move(call->out), call->args);
+    }
+
+    /**
+     * @brief Executes a pipeline like "generate 1000 | filter x | count", where each command reads the output of the one before it
+     *        from args.input, and returns the output of the last command
+     *
+     * @remark The commands run at the same time, each but the last on a thread of its own, so the stages of a multi-stage
+     *         transformation work in parallel. Output goes from one command to the next in chunks, through a queue that holds
+     *         a few chunks at most, so memory use doesn't grow with the amount of output. A command that writes faster than
+     *         the next one reads waits for it
+     * @remark The first command gets no input (args.input is nullptr). Once a command returns, the rest of its input is discarded,
+     *         so the commands before it finish without waiting. Commands must be safe to run concurrently
+     * @remark Input without a '|' runs like Execute, on the calling thread
+     * @param input The pipeline to parse and execute
+     * @return CommandOutput The output of the last command, or the error of the first command that failed
+     */
+    CommandOutput ExecutePipeline(const std::string &input) {
+        StringOutputSink sink;
+        CommandOutput out = RunPipeline(input, sink);
+        if (out.success) {
+            out.out = std::move(sink.out);
+        }
+        return out;
+    }
+
+    /**
+     * @brief Executes a pipeline like ExecutePipeline(const std::string &), writing the output of the last command to a sink
+     *        as it is produced, followed by a newline on success, like ExecuteIntoSink
+     *
+     * @param input The pipeline to parse and execute
+     * @param sink The sink to send output to
+     * @param error_stream The stream to send error output to. std::cerr by default
+     * @return CommandOutput The success of the pipeline, and the error of the first command that failed
+     */
+    CommandOutput ExecutePipelineIntoSink(const std::string &input, OutputSink &sink, std::ostream &error_stream = std::cerr) {
+        CommandOutput out = RunPipeline(input, sink);
+        if (out.success) {
+            sink.Write("\n");
+        } else {
+            error_stream << out.out << std::endl;
+        }
+        return out;
+    }
+
+#ifdef EASYCLI_COROUTINES
+    /**
+     * @brief Starts a command on an event loop and calls on_complete with its output once it has finished
+     *
+     * @remark Returns before the command runs: it runs on the threads calling loop.Run(), which also call on_complete.
+     *         A coroutine command gives its thread back at each co_await, so thousands of them can be in flight on a few threads.
+     *         Other commands hold the thread until they return. Only available in C++20
+     * @remark The command and its arguments are copied when it starts, so registering commands meanwhile doesn't affect it
+     * @param input The user input to parse and execute
+     * @param loop The loop to run the command on
+     * @param on_complete Called with the output of the command, or an error output if the command is unknown
+     */
+    void ExecuteAsync(const std::string &input, EventLoop &loop, std::function<void(CommandOutput &&)> on_complete) {
+        std::unique_ptr<detail::AsyncOperation> operation;
+        CommandOutput unknown;
+        Dispatch(Tokenizer(input), [&](const CommandFunction *fn, CommandArguments &args, const EasyCLI &owner) {
+            if (fn == nullptr) {
+                unknown = owner.Unknown(args.command);
+                return;
+            }
+            operation = std::make_unique<detail::AsyncOperation>(detail::AsyncOperation{args, *fn});
+            detail::ResolveFlags(operation->args, operation->fn);
+        });
+        loop.Spawn(operation ? detail::RunOperation(std::move(operation)) : detail::ReadyTask(std::move(unknown)), std::move(on_complete));
+    }
+#endif
+
+    /**
+     * @brief Parses a command once, for inputs that are executed many times
+     *
+     * @remark The returned handle's Execute skips parsing and the registry lookup
+     * @param input The user input to parse
+     * @return PreparedCommand The handle. It must not outlive this EasyCLI
+     */
+    PreparedCommand Prepare(const std::string &input) const;
+
+    /**
+     * @brief Executes many independent commands in parallel and calls a callback with each output as it completes
+     *
+     * @remark The lines are split into chunks that run as tasks on pool, so the callback is called from the worker threads,
+     *         possibly concurrently and in any order. The call returns once every line has been executed.
+     *         Commands must be safe to run concurrently, and registering commands meanwhile needs EnableConcurrentAccess
+     * @remark If a command or the callback throws, the lines not started yet are skipped, and the first exception is rethrown
+     *         once every chunk has stopped
+     * @param lines The user inputs to parse and execute
+     * @param count The number of lines
+     * @param pool The thread pool to run on
+     * @param on_complete Called with the index of each line and its output
+     * @param chunk_size The number of lines per task
+     */
+    void ExecuteBatch(const std::string *lines, std::size_t count, WorkStealingPool &pool, const std::function<void(std::size_t, CommandOutput &&)> &on_complete,
+                      std::size_t chunk_size = 64) {
+        chunk_size = std::max<std::size_t>(1, chunk_size);
+        const std::size_t chunks = (count + chunk_size - 1) / chunk_size;
+        std::size_t remaining = chunks;
+        std::exception_ptr error;
+        std::atomic<bool> failed{false};
+        std::mutex done_mutex;
+        std::condition_variable done;
+        for (std::size_t chunk = 0; chunk < chunks; chunk++) {
+            pool.Submit([&, chunk] {
+                std::exception_ptr chunk_error;
+                try {
+                    const std::size_t end = std::min(count, (chunk + 1) * chunk_size);
+                    for (std::size_t i = chunk * chunk_size; i < end && !failed.load(std::memory_order_relaxed); i++) {
+                        on_complete(i, Execute(lines[i]));
+                    }
+                } catch (...) {
+                    chunk_error = std::current_exception();
+                    failed.store(true, std::memory_order_relaxed);
+                }
+                // Decrement under the lock so this thread is done with done_mutex before ExecuteBatch can return
+                std::lock_guard<std::mutex> lock(done_mutex);
+                if (chunk_error && !error) {
+                    error = std::move(chunk_error);
+                }
+                if (--remaining == 0) {
+                    done.notify_all();
+                }
+            });
+        }
+        // Help run the chunks instead of just waiting, then wait for the ones other threads are running
+        while (pool.TryRunOne()) {
+        }
+        {
+            std::unique_lock<std::mutex> lock(done_mutex);
+            done.wait(lock, [&] { return remaining == 0; });
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    /**
+     * @brief Executes many independent commands in parallel and returns their outputs in input order
+     *
+     * @param lines The user inputs to parse and execute
+     * @param count The number of lines
+     * @param pool The thread pool to run on
+     * @param chunk_size The number of lines per task
+     * @return The output of each line, at the same index as the line
+     */
+    std::vector<CommandOutput> ExecuteBatch(const std::string *lines, std::size_t count, WorkStealingPool &pool, std::size_t chunk_size = 64) {
+        std::vector<CommandOutput> outputs(count);
+        ExecuteBatch(
+            lines, count, pool, [&outputs](std::size_t index, CommandOutput &&out) { outputs[index] = std::move(out); }, chunk_size);
+        return outputs;
+    }
+
+    /**
+     * @brief Same as ExecuteBatch(lines, count, pool), for a vector of lines
+     */
+    std::vector<CommandOutput> ExecuteBatch(const std::vector<std::string> &lines, WorkStealingPool &pool, std::size_t chunk_size = 64) {
+        return ExecuteBatch(lines.data(), lines.size(), pool, chunk_size);
+    }
+
+    /**
+     * @brief Gets a list of all the commands registered as a vector of strings
+     *
+     * @return A vector of strings containing all the commands, sorted
+     */
+    std::vector<std::string> GetCommandsString() const {
+        return Complete(std::string_view());
+    }
+
+    /**
+     * @brief Gets the names of the commands that start with prefix, for tab completion
+     *
+     * @remark Takes O(prefix + results) time, however many commands are registered
+     * @return The matching names, sorted
+     */
+    std::vector<std::string> Complete(std::string_view prefix) const {
+        std::vector<std::string> names;
+        if (index) {
+            std::lock_guard<std::mutex> lock(index->mutex);
+            index->trie.Complete(prefix, names);
+        }
+        return names;
+    }
+
+    /**
+     * @brief Gets the names of the commands closest to a misspelled name
+     *
+     * @remark Uses an index of name signatures kept up to date by RegisterCommand, which rules out most names without comparing
+     *         them. The rest are compared with a bit-parallel edit distance
+     * @param name The misspelled name
+     * @param max_results How many names to return at most
+     * @param max_distance How many insertions, deletions and substitutions away a name may be
+     * @return The names, closest first, ties sorted by name
+     */
+    std::vector<std::string> Suggest(std::string_view name, std::size_t max_results = 3, std::size_t max_distance = 2) const {
+        std::vector<std::string> names;
+        if (index) {
+            std::vector<std::pair<std::size_t, std::string>> found;
+            {
+                std::lock_guard<std::mutex> lock(index->mutex);
+                found = index->spelling.Search(name, max_distance, max_results);
+            }
+            for (auto &candidate : found) {
+                names.push_back(std::move(candidate.second));
+            }
+        }
+        return names;
+    }
+
+    /**
+     * @brief Gets the memory used by the index of command names behind Complete, Suggest and abbreviations, in bytes
+     */
+    std::size_t GetIndexMemoryUsage() const {
+        if (!index) {
+            return 0;
+        }
+        std::lock_guard<std::mutex> lock(index->mutex);
+        return index->MemoryUsage();
+    }
+
+    /**
+     * @brief gets a list of all the commands registered as a vector of CommandFunction
+     *
+     * @return a vector of CommandFunction containing all the commands
+     */
+    std::vector<CommandFunction> GetCommands() const {
+        std::vector<CommandFunction> command_list;
+        const detail::RegistryReadGuard registry = ReadRegistry();
+        for (const auto &command : registry.Commands()) {
+            command_list.push_back(command.second);
+        }
+        return command_list;
+    }
+
+    /**
+     * @brief Executes a command straight from argv and returns the output
+     *
+     * @remark Each argv entry is one token, so nothing is joined or re-tokenized
+     *         and arguments that contain spaces reach the command whole
+     * @param argc The argc from main()
+     * @param argv The argv from main(). argv[0] (the program name) is skipped
+     * @return CommandOutput The output of the command or an error output if the command failed.
+     */
+    CommandOutput ExecuteArgv(int argc, char **argv) {
+        return Dispatch(detail::ArgvTokens{argc, argv, 1}, CallOrUnknown);
+    }
+
+    /**
+     * @brief Executes a command straight from argv, writing its output to a sink as it is produced
+     *
+     * @param argc The argc from main()
+     * @param argv The argv from main(). argv[0] (the program name) is skipped
+     * @param sink The sink to send output to
+     * @param timeout How long the command may run, like with ExecuteWithTimeout. No limit by default
+     * @return CommandOutput The success of the command, and the error output if it failed.
+     */
+    CommandOutput ExecuteArgvIntoSink(int argc, char **argv, OutputSink &sink, std::chrono::nanoseconds timeout = std::chrono::nanoseconds::max()) {
+        const std::chrono::steady_clock::time_point deadline = detail::DeadlineAfter(timeout);
+        return Dispatch(detail::ArgvTokens{argc, argv, 1}, [&sink, deadline](const CommandFunction *fn, CommandArguments &args, const EasyCLI &owner) {
+            if (fn == nullptr) {
+                return owner.Unknown(args.command);
+            }
+            args.deadline = deadline;
+            return detail::CheckInterrupted(Call(*fn, args, sink), args);
+        });
+    }
+
+    /**
+     * @brief Executes a command from argv, sending output to std::cout and errors to std::cerr.
+     *        Prints the available commands to std::cerr if no command was given
+     *
+     * @param argc the argc from main()
+     * @param argv the argv array from main()
+     * @param cout_output whether to write the output of a successful command to std::cout
+     * @param cerr_output whether to write errors to std::cerr
+     */
+    void Run(int argc, char **argv, bool cout_output = true, bool cerr_output = true) {
+        if (argc > 1) {
+            StreamOutputSink cout_sink(std::cout);
+            detail::NullOutputSink null_sink;
+            CommandOutput out = ExecuteArgvIntoSink(argc, argv, cout_output ? static_cast<OutputSink &>(cout_sink) : null_sink);
+            if (out.success && cout_output) {
+                std::cout << std::endl;
+            } else if (!out.success && cerr_output) {
+                std::cerr << out.out << std::endl;
+            }
+        } else if (cerr_output) {
+            std::cerr << "Available commands:" << std::endl;
+            for (const auto &command : GetCommandsString()) {
+                std::cerr << "\t- " << command << std::endl;
+            }
+        }
+    }
+
+    /**
+     * @brief Same as Run(argc, argv), for a null-terminated argv
+     *
+     * @param argv the argv array from main()
+     */
+    void Run(char **argv, bool cout_output = true, bool cerr_output = true) {
+        int argc = 0;
+        while (argv[argc] != nullptr) {
+            argc++;
+        }
+        Run(argc, argv, cout_output, cerr_output);
+    }
+
+    /**
+     * @brief Executes every line of a stream as a command, for scripts piped to the program and for interactive use
+     *
+     * @remark The input is read in large blocks and split into lines in place, so no line is copied. The output of successful
+     *         commands, each followed by a newline, goes through a BufferedOutputSink that is flushed when it is full and before
+     *         waiting for input. Blank lines are skipped and a trailing '\r' is ignored
+     * @remark Only the characters already buffered by the stream are read without blocking. std::cin buffers nothing unless
+     *         std::ios::sync_with_stdio(false) was called, so large piped input is faster with the file descriptor overload
+     * @param input The stream to read commands from
+     * @param output_stream The stream to send output to. std::cout by default
+     * @param error_stream The stream to send error output to. std::cerr by default
+     * @return std::size_t The number of commands that failed
+     */
+    std::size_t RunStream(std::istream &input, std::ostream &output_stream = std::cout, std::ostream &error_stream = std::cerr) {
+        StreamOutputSink output_target(output_stream);
+        BufferedOutputSink output(output_target, BufferedOutputSink::kDefaultFlushBytes, std::chrono::milliseconds::max());
+        StreamOutputSink errors(error_stream);
+        std::streambuf *buffer = input.rdbuf();
+        return RunLines(
+            [buffer, &output](char *data, std::size_t size) -> std::size_t {
+                if (buffer == nullptr) {
+                    return 0;
+                }
+                std::streamsize available = buffer->in_avail();
+                if (available <= 0) {
+                    // Reading will block: show the output so far first
+                    output.Flush();
+                    if (buffer->sgetc() == std::char_traits<char>::eof()) {
+                        return 0;
+                    }
+                    available = std::max<std::streamsize>(buffer->in_avail(), 1);
+                }
+                return static_cast<std::size_t>(buffer->sgetn(data, std::min(available, static_cast<std::streamsize>(size))));
+            },
+            output, errors);
+    }
+
+#ifdef EASYCLI_POSIX
+    /**
+     * @brief Executes every line read from a file descriptor as a command, like RunStream(std::istream &)
+     *
+     * @remark Each read takes whatever is available, up to 64 KiB: whole blocks of a piped file, or a line typed in a terminal.
+     *         Output is written with writev in large batches. Only available on POSIX systems
+     * @param input_fd The file descriptor to read commands from. stdin by default
+     * @param output_fd The file descriptor to send output to. stdout by default
+     * @param error_fd The file descriptor to send error output to. stderr by default
+     * @return std::size_t The number of commands that failed
+     */
+    std::size_t RunStream(int input_fd = STDIN_FILENO, int output_fd = STDOUT_FILENO, int error_fd = STDERR_FILENO) {
+        BufferedOutputSink output(output_fd, BufferedOutputSink::kDefaultFlushBytes, std::chrono::milliseconds::max());
+        FdOutputSink errors(error_fd);
+        return RunLines(
+            [input_fd, &output](char *data, std::size_t size) -> std::size_t {
+                output.Flush();
+                for (;;) {
+                    const ssize_t got = ::read(input_fd, data, size);
+                    if (got < 0 && errno == EINTR) {
+                        continue;
+                    }
+                    return got > 0 ? static_cast<std::size_t>(got) : 0;
+                }
+            },
+            output, errors);
+    }
+#endif
+
+    /**
+     * @brief Executes every line of a script file as a command
+     *
+     * @remark On POSIX systems the file is memory-mapped and lines are parsed straight from the mapping, so nothing is copied
+     *         and the first command runs before the rest of the file is read. Elsewhere the file is read into memory first
+     * @remark Lines are handled like RunStream does. Throws std::runtime_error if the file can't be opened
+     * @param path The path of the script
+     * @param output_stream The stream to send output to. std::cout by default
+     * @param error_stream The stream to send error output to. std::cerr by default
+     * @return std::size_t The number of commands that failed
+     */
+    std::size_t ExecuteFile(const std::string &path, std::ostream &output_stream = std::cout, std::ostream &error_stream = std::cerr) {
+        const detail::MappedFile file(path);
+        StreamOutputSink output_target(output_stream);
+        BufferedOutputSink output(output_target, BufferedOutputSink::kDefaultFlushBytes, std::chrono::milliseconds::max());
+        StreamOutputSink errors(error_stream);
+        return ExecuteLines(file.View(), output, errors);
+    }
+
+    /**
+     * @brief Executes every line of a script file as a command, running chunks of the file in parallel
+     *
+     * @remark The file is split into chunks of about chunk_bytes at line boundaries, which run as tasks on pool. Each chunk
+     *         collects its output, which is written in file order as soon as the chunks before it are done. Only a few chunks
+     *         run ahead of the next one to write, so memory use doesn't grow with the file
+     * @remark Commands must be safe to run concurrently, and must not depend on the commands of the lines before them
+     * @remark If a command throws, the chunks not started yet are skipped, and the exception of the first chunk in the file
+     *         that threw is rethrown once the running chunks have stopped
+     * @param path The path of the script
+     * @param pool The thread pool to run on
+     * @param output_stream The stream to send output to. std::cout by default
+     * @param error_stream The stream to send error output to. std::cerr by default
+     * @param chunk_bytes The size of the chunks the file is split into
+     * @return std::size_t The number of commands that failed
+     */
+    std::size_t ExecuteFile(const std::string &path, WorkStealingPool &pool, std::ostream &output_stream = std::cout, std::ostream &error_stream = std::cerr,
+                            std::size_t chunk_bytes = 1024 * 1024) {
+        const detail::MappedFile file(path);
+        const std::string_view text = file.View();
+        struct Chunk {
+            std::string_view text;
+            StringOutputSink output;
+            StringOutputSink errors;
+            std::size_t failures = 0;
+            std::exception_ptr error;
+            bool done = false;
+        };
+        std::vector<Chunk> chunks;
+        for (std::size_t begin = 0; begin < text.size();) {
+            std::size_t end = begin + std::max<std::size_t>(1, chunk_bytes);
+            if (end < text.size()) {
+                const std::size_t newline = text.find('\n', end - 1);
+                end = newline != std::string_view::npos ? newline + 1 : text.size();
+            } else {
+                end = text.size();
+            }
+            chunks.emplace_back();
+            chunks.back().text = text.substr(begin, end - begin);
+            begin = end;
+        }
+
+        std::mutex done_mutex;
+        std::condition_variable done;
+        std::atomic<bool> failed{false};
+        const auto is_done = [&done_mutex](const Chunk &chunk) {
+            std::lock_guard<std::mutex> lock(done_mutex);
+            return chunk.done;
+        };
+        const std::size_t window = 2 * pool.Size() + 2;
+        std::size_t submitted = 0;
+        std::size_t failures = 0;
+        StreamOutputSink output(output_stream);
+        StreamOutputSink errors(error_stream);
+        for (std::size_t next = 0; next < chunks.size(); next++) {
+            for (; submitted < chunks.size() && submitted < next + window; submitted++) {
+                Chunk &chunk = chunks[submitted];
+                pool.Submit([this, &chunk, &done_mutex, &done, &failed] {
+                    std::size_t chunk_failures = 0;
+                    std::exception_ptr error;
+                    if (!failed.load(std::memory_order_relaxed)) {
+                        try {
+                            chunk_failures = ExecuteLines(chunk.text, chunk.output, chunk.errors);
+                        } catch (...) {
+                            error = std::current_exception();
+                            failed.store(true, std::memory_order_relaxed);
+                        }
+                    }
+                    // Notify under the lock so this thread is done with done_mutex before ExecuteFile can return
+                    std::lock_guard<std::mutex> lock(done_mutex);
+                    chunk.failures = chunk_failures;
+                    chunk.error = std::move(error);
+                    chunk.done = true;
+                    done.notify_all();
+                });
+            }
+            // Help run the chunks instead of just waiting, then wait for the one to write next
+            Chunk &chunk = chunks[next];
+            while (!is_done(chunk) && pool.TryRunOne()) {
+            }
+            {
+                std::unique_lock<std::mutex> lock(done_mutex);
+                done.wait(lock, [&chunk] { return chunk.done; });
+            }
+            if (chunk.error) {
+                // The chunks already submitted still reference this frame, so wait for them before leaving it
+                std::unique_lock<std::mutex> lock(done_mutex);
+                for (std::size_t i = next + 1; i < submitted; i++) {
+                    done.wait(lock, [&chunks, i] { return chunks[i].done; });
+                }
+                output.Flush();
+                std::rethrow_exception(chunk.error);
+            }
+            output.Write(chunk.output.out);
+            errors.Write(chunk.errors.out);
+            failures += chunk.failures;
+            std::string().swap(chunk.output.out);
+            std::string().swap(chunk.errors.out);
+        }
+        output.Flush();
+        return failures;
+    }
+
+  protected:
+    friend class PreparedCommand;
+    friend struct detail::CommandGroup;
+
+    /**
+     * @brief Gives access to the registry for the duration of a call: the live map, or the current snapshot in concurrent mode
+     */
+    detail::RegistryReadGuard ReadRegistry() const {
+        if (concurrent) {
+            return detail::RegistryReadGuard(*concurrent);
+        }
+        return detail::RegistryReadGuard(commands);
+    }
+
+    /**
+     * @brief Builds the error output for an unknown command, with suggestions if they are enabled
+     */
+    CommandOutput Unknown(std::string_view name) const {
+        if (name.empty() && !path.empty()) {
+            return detail::MissingSubcommand(path, Complete(std::string_view()));
+        }
+        CommandOutput out = path.empty() ? detail::UnknownCommand(name) : detail::UnknownCommand(path + ' ' + std::string(name));
+        if (suggestions == 0 || name.empty()) {
+            return out;
+        }
+        const std::vector<std::string> names = Suggest(name, suggestions, std::min(suggestion_distance, (name.size() + 1) / 2));
+        for (std::size_t i = 0; i < names.size(); i++) {
+            out.out += i == 0 ? ". Did you mean \"" : i + 1 == names.size() ? " or \"" : ", \"";
+            out.out += names[i];
+            out.out += '"';
+        }
+        if (!names.empty()) {
+            out.out += '?';
+        }
+        return out;
+    }
+
+    /**
+     * @brief Looks a command up in the registry, then as an abbreviation if they are enabled
+     */
+    const CommandFunction *Lookup(const detail::RegistryReadGuard &registry, std::string_view name) const {
+        const CommandFunction *fn = registry.Find(name);
+        if (fn == nullptr && abbreviations && !name.empty() && index) {
+            std::string full_name;
+            if (const detail::RadixTrie *names = registry.Names()) {
+                full_name = names->UniqueCompletion(name);
+            } else {
+                std::lock_guard<std::mutex> lock(index->mutex);
+                full_name = index->trie.UniqueCompletion(name);
+            }
+            if (!full_name.empty()) {
+                fn = registry.Find(full_name);
+            }
+        }
+        return fn;
+    }
+
+    /**
+     * @brief Copies the command names for a registry snapshot if abbreviations need them. Writers call this with the writer
+     *        mutex held, so the snapshot they publish has every name inserted before theirs
+     */
+    std::shared_ptr<const detail::RadixTrie> NamesSnapshot() const {
+        if (!abbreviations || !index) {
+            return nullptr;
+        }
+        std::lock_guard<std::mutex> lock(index->mutex);
+        return std::make_shared<const detail::RadixTrie>(index->trie);
+    }
+
+    /**
+     * @brief Adds or replaces a command. Every RegisterCommand overload ends up here
+     */
+    void StoreCommand(const std::string &name, CommandFunction fn) {
+        std::unique_lock<std::mutex> lock;
+        if (concurrent) {
+            lock = std::unique_lock<std::mutex>(concurrent->writer);
+        }
+        StoreCommandLocked(name, std::move(fn));
+    }
+
+    /**
+     * @brief StoreCommand, for callers that hold the writer mutex in concurrent mode
+     */
+    void StoreCommandLocked(const std::string &name, CommandFunction fn) {
+        if (!index) {
+            // Moved from
+            index = std::make_unique<detail::CommandIndex>();
+        }
+        {
+            std::lock_guard<std::mutex> lock(index->mutex);
+            index->Insert(name);
+        }
+        if (stats) {
+            fn = Instrument(name, std::move(fn));
+        }
+        commands[name] = std::move(fn);
+        if (concurrent) {
+            concurrent->Publish(commands, NamesSnapshot());
+        }
+        detail::registry_generation.fetch_add(1, std::memory_order_release);
+    }
+
+    /**
+     * @brief Makes a command record into the counters of name. Groups are left alone, and coroutine commands record when they finish
+     */
+    CommandFunction Instrument(const std::string &name, CommandFunction fn) const {
+        if (fn.target<detail::CommandGroup>() != nullptr) {
+            return fn;
+        }
+        std::shared_ptr<const FlagSet> known_flags = fn.KnownFlags();
+#ifdef EASYCLI_COROUTINES
+        if (const detail::AsyncCommand *async = fn.target<detail::AsyncCommand>()) {
+            detail::AsyncCommand instrumented = *async;
+            instrumented.counters = stats->Get(name);
+            fn = std::move(instrumented);
+            fn.SetKnownFlags(std::move(known_flags));
+            return fn;
+        }
+#endif
+        fn = detail::InstrumentedCommand{std::move(fn), stats->Get(name)};
+        fn.SetKnownFlags(std::move(known_flags));
+        return fn;
+    }
+
+    /**
+     * @brief The loop behind RunStream: reads blocks with read(data, size), which returns 0 at the end of the input,
+     *        and executes each line in them
+     */
+    template <typename Read> std::size_t RunLines(Read read, OutputSink &output, OutputSink &errors) {
+        std::vector<char> buffer(64 * 1024);
+        // The first `held` bytes of the buffer are the partial last line of the previous read
+        std::size_t held = 0;
+        std::size_t failures = 0;
+        for (bool at_end = false; !at_end;) {
+            // A line longer than the buffer makes it grow
+            if (held == buffer.size()) {
+                buffer.resize(buffer.size() * 2);
+            }
+            const std::size_t got = read(buffer.data() + held, buffer.size() - held);
+            at_end = got == 0;
+            const std::string_view text(buffer.data(), held + got);
+            // Execute the complete lines, and the last one too at the end of the input
+            const std::size_t complete = at_end ? text.size() : text.rfind('\n') + 1;
+            failures += ExecuteLines(text.substr(0, complete), output, errors);
+            held = text.size() - complete;
+            std::copy(text.begin() + complete, text.end(), buffer.begin());
+        }
+        return failures;
+    }
+
+    /**
+     * @brief Executes each line of text as a command, the last one even without a trailing newline
+     *
+     * @return std::size_t The number of commands that failed
+     */
+    std::size_t ExecuteLines(std::string_view text, OutputSink &output, OutputSink &errors) {
+        const detail::ArgumentsLease lease;
+        std::size_t failures = 0;
+        while (!text.empty()) {
+            const std::size_t newline = text.find('\n');
+            std::string_view line = text.substr(0, newline);
+            text.remove_prefix(newline != std::string_view::npos ? newline + 1 : text.size());
+            if (!line.empty() && line.back() == '\r') {
+                line.remove_suffix(1);
+            }
+
+            Tokenizer tokens(line);
+            CommandArguments &args = lease.ParseCommand(tokens);
+            if (args.command.empty()) {
+                continue;
+            }
+            const CommandOutput out = Dispatch(lease, tokens, args, [&output](const CommandFunction *fn, CommandArguments &parsed, const EasyCLI &owner) {
+                return fn ? Call(*fn, parsed, output) : owner.Unknown(parsed.command);
+            });
+            if (out.success) {
+                output.Write("\n");
+            } else {
+                // Keep the errors in order with the output before them
+                output.Flush();
+                errors.Write(out.out);
+                errors.Write("\n");
+                failures++;
+            }
+        }
+        return failures;
+    }
+
+    template <typename Found> using DispatchResult = std::invoke_result_t<Found &, const CommandFunction *, CommandArguments &, const EasyCLI &>;
+
+    /**
+     * @brief Parses tokens into the arguments of the command they name and calls found(fn, args, owner) with them
+     */
+    template <typename Tokens, typename Found> DispatchResult<Found> Dispatch(Tokens tokens, Found &&found) const {
+        const detail::ArgumentsLease lease;
+        return Dispatch(lease, tokens, lease.ParseCommand(tokens), found);
+    }
+
+    /**
+     * @brief Looks args.command up, walking down groups by taking the next token as the name to look up in the group,
+     *        then parses the tokens left into args and calls found(fn, args, owner)
+     *
+     * @remark fn is the command, or nullptr if there is none, and owner is the EasyCLI it was looked up in, for the error.
+     *         The registry of each group is held until found returns
+     */
+    template <typename Tokens, typename Found>
+    DispatchResult<Found> Dispatch(const detail::ArgumentsLease &lease, Tokens &tokens, CommandArguments &args, Found &&found) const {
+        const detail::RegistryReadGuard registry = ReadRegistry();
+        const CommandFunction *fn = Lookup(registry, args.command);
+        const detail::CommandGroup *group = fn != nullptr ? fn->target<detail::CommandGroup>() : nullptr;
+        if (group == nullptr) {
+            lease.ParseRest(tokens);
+            return found(fn, args, *this);
+        }
+        lease.ParseCommand(tokens);
+        return group->cli->Dispatch(lease, tokens, args, found);
+    }
+
+    /**
+     * @brief Runs the subcommand named by the first argument of args, for a group called with arguments already parsed for it
+     */
+    CommandOutput ExecuteSubcommand(const CommandArguments &args, OutputSink *sink) const {
+        CommandArguments subcommand_args = args;
+        subcommand_args.command.clear();
+        if (!subcommand_args.arguments.empty()) {
+            subcommand_args.command = std::move(subcommand_args.arguments.front());
+            subcommand_args.arguments.erase(subcommand_args.arguments.begin());
+        }
+        const detail::RegistryReadGuard registry = ReadRegistry();
+        const CommandFunction *fn = Lookup(registry, subcommand_args.command);
+        if (fn == nullptr) {
+            return Unknown(subcommand_args.command);
+        }
+        return sink != nullptr ? Call(*fn, subcommand_args, *sink) : Call(*fn, subcommand_args);
+    }
+
+    // Runs one stage of a pipeline, reading from input and writing to sink
+    CommandOutput RunStage(std::string_view stage, InputSource *input, OutputSink &sink) {
+        return Dispatch(Tokenizer(stage), [input, &sink](const CommandFunction *fn, CommandArguments &args, const EasyCLI &owner) {
+            if (fn == nullptr) {
+                return owner.Unknown(args.command);
+            }
+            args.input = input;
+            return Call(*fn, args, sink);
+        });
+    }
+
+    // Runs every stage of a pipeline at once, the last one on the calling thread writing to sink
+    CommandOutput RunPipeline(std::string_view input, OutputSink &sink) {
+        const std::vector<std::string_view> stages = detail::SplitPipeline(input);
+        if (stages.size() == 1) {
+            return RunStage(stages[0], nullptr, sink);
+        }
+        for (std::string_view stage : stages) {
+            std::string_view token;
+            if (!Tokenizer(stage).Next(token)) {
+                return CommandOutput{"Missing command in pipeline: \"" + std::string(input) + "\"", false};
+            }
+        }
+
+        struct Stage {
+            std::unique_ptr<detail::ChunkQueue> output;
+            CommandOutput result;
+            std::exception_ptr error;
+        };
+        std::vector<Stage> results(stages.size());
+        for (std::size_t i = 0; i + 1 < stages.size(); i++) {
+            results[i].output = std::make_unique<detail::ChunkQueue>(detail::kPipeQueueChunks);
+        }
+        // Closes both queues of a stage when it returns, so the stages around it don't wait for it forever
+        const auto run = [this, &stages, &results, &sink](std::size_t i) {
+            detail::ChunkQueue *in_queue = i > 0 ? results[i - 1].output.get() : nullptr;
+            detail::ChunkQueue *out_queue = results[i].output.get();
+            try {
+                std::unique_ptr<detail::PipeInputSource> source = in_queue ? std::make_unique<detail::PipeInputSource>(*in_queue) : nullptr;
+                if (out_queue != nullptr) {
+                    detail::PipeOutputSink pipe(*out_queue, detail::kPipeChunkBytes);
+                    results[i].result = RunStage(stages[i], source.get(), pipe);
+                    pipe.Flush();
+                } else {
+                    results[i].result = RunStage(stages[i], source.get(), sink);
+                }
+            } catch (...) {
+                results[i].error = std::current_exception();
+            }
+            if (in_queue != nullptr) {
+                in_queue->CloseReader();
+            }
+            if (out_queue != nullptr) {
+                out_queue->CloseWriter();
+            }
+        };
+        std::vector<std::thread> threads;
+        try {
+            threads.reserve(stages.size() - 1);
+            for (std::size_t i = 0; i + 1 < stages.size(); i++) {
+                threads.emplace_back(run, i);
+            }
+        } catch (...) {
+            // The stages already started may wait on ones that never will, so end all their input and output first
+            for (Stage &stage : results) {
+                if (stage.output) {
+                    stage.output->CloseReader();
+                    stage.output->CloseWriter();
+                }
+            }
+            for (std::thread &thread : threads) {
+                thread.join();
+            }
+            throw;
+        }
+        run(stages.size() - 1);
+        for (std::thread &thread : threads) {
+            thread.join();
+        }
+
+        for (Stage &stage : results) {
+            if (stage.error) {
+                std::rethrow_exception(stage.error);
+            }
+        }
+        for (Stage &stage : results) {
+            if (!stage.result.success) {
+                return std::move(stage.result);
+            }
+        }
+        return std::move(results.back().result);
+    }
+
+    // Calls each group registered here
+    template <typename F> void ForEachGroup(F f) {
+        for (auto &command : commands) {
+            if (const detail::CommandGroup *group = command.second.target<detail::CommandGroup>()) {
+                f(*group->cli);
+            }
+        }
+    }
+
+    static CommandOutput CallOrUnknown(const CommandFunction *fn, CommandArguments &args, const EasyCLI &owner) {
+        return fn != nullptr ? Call(*fn, args) : owner.Unknown(args.command);
+    }
+
+    // Calls a command found in the registry, after setting the bits of the flags it declared
+    static CommandOutput Call(const CommandFunction &fn, CommandArguments &args) {
+        detail::ResolveFlags(args, fn);
+        return fn(args);
+    }
+
+    static CommandOutput Call(const CommandFunction &fn, CommandArguments &args, OutputSink &sink) {
+        detail::ResolveFlags(args, fn);
+        return fn(args, sink);
+    }
+
+    // Counts a call to an instrumented command that was given up before it ran, as a failure and, past its deadline, a timeout
+    static void RecordSkipped(const CommandFunction &fn, const CommandArguments &args, std::chrono::steady_clock::time_point start) {
+        detail::CommandStatsCounters *counters = nullptr;
+        if (const detail::InstrumentedCommand *instrumented = fn.target<detail::InstrumentedCommand>()) {
+            counters = instrumented->counters.get();
+        }
+#ifdef EASYCLI_COROUTINES
+        if (const detail::AsyncCommand *async = fn.target<detail::AsyncCommand>()) {
+            counters = async->counters.get();
+        }
+#endif
+        if (counters != nullptr) {
+            detail::InstrumentedCommand::Record(*counters, CommandOutput{}, args, start);
+        }
+    }
+
+    CommandMap commands;
+    std::unique_ptr<detail::SnapshotRegistry> concurrent;
+    std::shared_ptr<detail::StatsTable> stats;
+    std::unique_ptr<detail::CommandIndex> index = std::make_unique<detail::CommandIndex>();
+    // The names that lead to this EasyCLI if it is a group, like "cluster node". Empty otherwise
+    std::string path;
+    bool abbreviations = false;
+    // How many names to suggest for an unknown command, 0 when suggestions are disabled
+    std::size_t suggestions = 0;
+    std::size_t suggestion_distance = 2;
+};
+
 /**
- * @brief  A struct that contains the parsed arguments of a command
- * @remark You, the user, needs to use this when you write your own commands
- *         as const CommandArguments &args is passed to your command function
+ * @brief A command parsed once by EasyCLI::Prepare, to be executed many times
+ * @remark It keeps the parsed arguments and a copy of the command it resolved, so Execute neither parses nor looks anything up.
+ *         Registering any command makes the next Execute look the command up again, so re-registering it takes effect,
+ *         and a command that was unknown when prepared runs once it is registered
+ * @remark The EasyCLI that prepared it must outlive it and must not be moved. A handle can be used by one thread at a time
  */
-struct CommandArguments {
-    std::string command;
-    std::vector<std::string> arguments;
-    std::vector<std::string> flags;
-
+class PreparedCommand {
+  public:
     /**
-     * @brief Returns true if the flags vector contains the specified flag
+     * @brief Executes the command and returns the output
      *
-     * @param flag The flag to check for
-     * @return true if the flags vector contains the specified flag
-     * @return false if the flags vector does not contain the specified flag
-     * @remark This is a convenience function that is equivalent to `std::find(arguments.begin(), arguments.end(), argument) != arguments.end();`
-     * @remark The time complexity of this function is O(n), where n is the number of flags
+     * @return CommandOutput The output of the command or an error output if the command is unknown
      */
-    bool flags_contains(const std::string &flag) const {
-        return std::find(flags.begin(), flags.end(), flag) != flags.end();
+    CommandOutput Execute() {
+        Refresh();
+        return fn ? fn(args) : owner->Unknown(args.command);
     }
 
     /**
-     * @brief Returns true if the arguments vector contains the specified flag
+     * @brief Executes the command, writing its output to sink as it is produced
      *
-     * @param flag The flag to check for
-     * @return true if the arguments vector contains the specified flag
-     * @return false if the arguments vector does not contain the specified flag
-     * @remark This is a convenience function that is equivalent to `std::find(arguments.begin(), arguments.end(), argument) != arguments.end();`
-     * @remark The time complexity of this function is O(n), where n is the number of arguments
+     * @return CommandOutput The success of the command, and the error output if it failed
      */
-    bool arguments_contains(const std::string &argument) const {
-        return std::find(arguments.begin(), arguments.end(), argument) != arguments.end();
+    CommandOutput Execute(OutputSink &sink) {
+        Refresh();
+        return fn ? fn(args, sink) : owner->Unknown(args.command);
     }
-};
 
-/**
- * @brief Parses a string into a CommandArguments struct
- *        For an input value of "echo hello world -oneline"
- *        The CommandArguments struct would look like this:
- *        {
- *            command: "echo",
- *            arguments: ["hello", "world"],
- *            flags: ["oneline"]
- *        }
- *
- * @remark You can use this directly, but it's simpler to use the variations of Execute{...} instead
- * @remark This uses Bash-like parsing, so "echo hello world" and "echo     hello     world" are equivalent
- * @param input The string to parse into a CommandArguments struct
- * @return CommandArguments The parsed CommandArguments struct
- */
-inline CommandArguments ParseArgs(const std::string &input) {
+    const CommandArguments &Arguments() const {
+        return args;
+    }
+
+  private:
+    friend class EasyCLI;
+
+    PreparedCommand(const EasyCLI &cli, const std::string &input) : cli(&cli), owner(&cli), input(input) {
+        Resolve();
+    }
+
+    void Refresh() {
+        if (generation != detail::registry_generation.load(std::memory_order_acquire)) {
+            Resolve();
+        }
+    }
+
+    void Resolve() {
+        // Read the generation first: a command registered during the lookup makes the next call resolve again
+        generation = detail::registry_generation.load(std::memory_order_acquire);
+        // Parse again too, since registering a group changes which tokens name the command
+        cli->Dispatch(Tokenizer(input), [this](const CommandFunction *found, CommandArguments &parsed, const EasyCLI &found_in) {
+            fn = found != nullptr ? *found : CommandFunction();
+            args = parsed;
+            owner = &found_in;
+        });
+        detail::ResolveFlags(args, fn);
+    }
+
+    const EasyCLI *cli;
+    // The EasyCLI, or the group, the command was looked up in
+    const EasyCLI *owner;
+    std::string input;
     CommandArguments args;
+    CommandFunction fn;
+    std::uint64_t generation = 0;
+};
 
-    std::istringstream iss(input);
-    std::string token;
+inline PreparedCommand EasyCLI::Prepare(const std::string &input) const {
+    return PreparedCommand(*this, input);
+}
 
-    // Extract the command
-    iss >> args.command;
+namespace detail {
+inline CommandOutput CommandGroup::operator()(const CommandArguments &args) const {
+    return cli->ExecuteSubcommand(args, nullptr);
+}
 
-    // Extract arguments and flags
-    while (iss >> token) {
-        if (token[0] == '-') {
-            // Token is a flag
-            args.flags.push_back(token.substr(1)); // Remove '-' and store the flag
-        } else {
-            // Token is an argument
-            args.arguments.push_back(token);
+inline CommandOutput CommandGroup::operator()(const CommandArguments &args, OutputSink &sink) const {
+    return cli->ExecuteSubcommand(args, &sink);
+}
+} // namespace detail
+
+#ifdef EASYCLI_POSIX
+namespace detail {
+// Daemon protocol, all integers in host byte order since both ends are on the same machine:
+//   request:  uint32 argc, then for each argv entry a uint32 length and the bytes
+//   response: frames of a 1-byte kind, a uint32 length and a payload, ending with an exit frame
+//             whose payload is the uint32 exit status (0 on success, 1 on failure)
+constexpr char kFrameOutput = 'o';
+constexpr char kFrameError = 'e';
+constexpr char kFrameExit = 'x';
+constexpr std::uint32_t kMaxRequestArgs = 1u << 16;
+constexpr std::uint32_t kMaxRequestArgLength = 1u << 24;
+
+inline bool SendAll(int fd, const void *data, std::size_t size) {
+#ifdef MSG_NOSIGNAL
+    const int flags = MSG_NOSIGNAL;
+#else
+    const int flags = 0;
+#endif
+    const char *bytes = static_cast<const char *>(data);
+    while (size > 0) {
+        const ssize_t sent = ::send(fd, bytes, size, flags);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
         }
+        bytes += sent;
+        size -= static_cast<std::size_t>(sent);
     }
+    return true;
+}
 
-    return args;
+/**
+ * @brief Receives exactly size bytes, giving up once deadline has passed. No deadline by default
+ */
+inline bool ReceiveAll(int fd, void *data, std::size_t size, std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max()) {
+    char *bytes = static_cast<char *>(data);
+    while (size > 0) {
+        if (deadline != std::chrono::steady_clock::time_point::max()) {
+            const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+            pollfd ready = {fd, POLLIN, 0};
+            const int polled = left.count() > 0 ? ::poll(&ready, 1, static_cast<int>(std::min<std::chrono::milliseconds::rep>(left.count() + 1, INT32_MAX))) : 0;
+            if (polled < 0 && errno == EINTR) {
+                continue;
+            }
+            if (polled <= 0) {
+                return false;
+            }
+        }
+        const ssize_t received = ::recv(fd, bytes, size, 0);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            return false;
+        }
+        bytes += received;
+        size -= static_cast<std::size_t>(received);
+    }
+    return true;
+}
+
+/**
+ * @brief Makes writes to a socket whose peer has gone fail with EPIPE instead of raising SIGPIPE, where send has no MSG_NOSIGNAL
+ */
+inline void DisableSigPipe(int fd) {
+#if !defined(MSG_NOSIGNAL) && defined(SO_NOSIGPIPE)
+    const int on = 1;
+    ::setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#else
+    (void)fd;
+#endif
 }
 
-using CommandFunction = std::function<CommandOutput(const CommandArguments &)>;
-using CommandMap = std::unordered_map<std::string, CommandFunction>;
+inline bool SendFrame(int fd, char kind, std::string_view payload) {
+    const std::uint32_t length = static_cast<std::uint32_t>(payload.size());
+    char header[1 + sizeof(length)];
+    header[0] = kind;
+    std::memcpy(header + 1, &length, sizeof(length));
+    return SendAll(fd, header, sizeof(header)) && SendAll(fd, payload.data(), payload.size());
+}
 
 /**
- * @brief  A class that makes it easy to create a CLI
- * @remark This class is not thread-safe (yet) but it should be fine for most use cases
+ * @brief Fills a sockaddr_un for a socket path, returning false if the path is too long
  */
-class EasyCLI {
+inline bool MakeSocketAddress(const std::string &path, sockaddr_un &address) {
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+/**
+ * @brief Clears the way for a server to listen at address: removes a socket left behind by a server that is gone
+ *
+ * @return false if something that isn't a socket is at the path, or a server still accepts connections on it
+ */
+inline bool RemoveStaleSocket(const sockaddr_un &address) {
+    struct stat info;
+    if (::lstat(address.sun_path, &info) != 0) {
+        return errno == ENOENT;
+    }
+    if (!S_ISSOCK(info.st_mode)) {
+        return false;
+    }
+    const int probe = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (probe < 0) {
+        return false;
+    }
+    const bool live = ::connect(probe, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) == 0;
+    ::close(probe);
+    return !live && ::unlink(address.sun_path) == 0;
+}
+
+/**
+ * @brief Sends command output to a daemon client as output frames, batching small writes
+ * @remark Once a send fails or times out, everything else is dropped: the client is gone or not reading, and a frame may have
+ *         been cut short, so nothing sent after it could be read correctly anyway
+ */
+class SocketOutputSink : public OutputSink {
   public:
-    EasyCLI() {
+    explicit SocketOutputSink(int fd) : fd(fd) {
     }
 
-    EasyCLI(const CommandMap &commands) : commands(commands) {
+    void Write(std::string_view data) override {
+        if (failed) {
+            return;
+        }
+        buffer += data;
+        if (buffer.size() >= 64 * 1024) {
+            Flush();
+        }
     }
 
-    /**
-     * @brief Adds a command to the list of commands
-     *
-     * @param name the name of the command to add. it should not contain spaces or the command will be unreachable by user input
-     * @param fn the callback function to call when the command is executed. Must be of type `std::function<CommandOutput(const CommandArguments &)>`
-     */
-    void RegisterCommand(const std::string &name, CommandFunction fn) {
-        commands[name] = fn;
+    void Flush() override {
+        if (!buffer.empty()) {
+            Send(kFrameOutput, buffer);
+            buffer.clear();
+        }
     }
 
     /**
-     * @brief Adds a command to the list of commands
-     *
-     * @param name the name of the command to add. it should not contain spaces or the command will be unreachable by user input
-     * @param fn the callback function to call when the command is executed. Must be of type `CommandOutput (*)(const CommandArguments &)`
+     * @brief Sends a frame unless an earlier send failed
      */
-    void RegisterCommand(const std::string &name, CommandOutput (*fn)(const CommandArguments &)) {
-        commands[name] = fn;
+    void Send(char kind, std::string_view payload) {
+        if (!failed && !SendFrame(fd, kind, payload)) {
+            failed = true;
+        }
     }
 
+  private:
+    int fd;
+    std::string buffer;
+    bool failed = false;
+};
+} // namespace detail
+
+/**
+ * @brief Serves an EasyCLI over a Unix domain socket, so short-lived clients (see ForwardToServer) reuse one warm process
+ *        instead of paying process startup and command registration on every invocation
+ * @remark Connections are handled one at a time on the thread that calls Serve. A client that doesn't send its request, or doesn't
+ *         read the reply, within the request timeout is dropped, so it can't hold up the others. Only available on POSIX systems
+ */
+class EasyCLIServer {
+  public:
     /**
-     * @brief Adds a command to the list of commands
-     *
-     * @tparam T the type of the callback function to call when the command is executed. Must be of type `CommandOutput (*)(const CommandArguments &)`
-     * @param name the name of the command to add. it should not contain spaces or the command will be unreachable by user input
-     * @param c the callback function to call when the command is executed. Must be of type `CommandOutput (*)(const CommandArguments &)`
+     * @param cli The CLI to dispatch requests to. It must outlive the server
+     * @param socket_path The path of the socket to listen on. A socket left there by a server that is gone is replaced
      */
-    template <typename T> void RegisterCommand(const std::string &name, T c) {
-        commands[name] = BINDFN(c);
+    EasyCLIServer(EasyCLI &cli, std::string socket_path) : cli(cli), socket_path(std::move(socket_path)) {
+        if (::pipe(stop_pipe) != 0) {
+            stop_pipe[0] = stop_pipe[1] = -1;
+        }
     }
 
-    /**
-     * @brief Executes a command from user input and returns the output
-     *
-     * @remark This is the most basic way to execute a command, but it's not the most convenient.
-     * @param input The user input to parse and execute
-     * @return CommandOutput The output of the command or an error output if the command failed.
-     */
-    CommandOutput Execute(const std::string &input) {
-        CommandArguments args = ParseArgs(input);
-        if (commands.find(args.command) != commands.end()) {
-            CommandOutput out = commands[args.command](args);
-            return out;
+    EasyCLIServer(const EasyCLIServer &) = delete;
+    EasyCLIServer &operator=(const EasyCLIServer &) = delete;
+
+    ~EasyCLIServer() {
+        for (int fd : stop_pipe) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
         }
-        const std::string error = "Unknown command: \"" + args.command + "\"";
-        return CommandOutput{error, false};
     }
 
     /**
-     * @brief Executes a command from user input and sends error output to a stream (std::cerr by default)
+     * @brief Accepts and answers requests until Stop is called
      *
-     * @param input The user input to parse and execute
-     * @param error_stream The stream to send error output to. std::cerr by default
-     * @return CommandOutput The output of the command or an error output if the command failed.
+     * @return true if the server ran and was stopped
+     * @return false if the socket couldn't be set up, because something other than a socket is at the path,
+     *         another server is listening on it, or a system call failed
      */
-    CommandOutput ExecuteWithErrStream(const std::string &input, std::ostream &error_stream = std::cerr) {
-        CommandArguments args = ParseArgs(input);
-        if (commands.find(args.command) != commands.end()) {
-            CommandOutput out = commands[args.command](args);
-            if (out.success) {
-                return out;
-            } else {
-                error_stream << out.out;
+    bool Serve() {
+        sockaddr_un address;
+        if (stop_pipe[0] < 0 || !detail::MakeSocketAddress(socket_path, address)) {
+            return false;
+        }
+        if (!detail::RemoveStaleSocket(address)) {
+            return false;
+        }
+        const int listen_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listen_fd < 0) {
+            return false;
+        }
+        if (::bind(listen_fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || ::listen(listen_fd, 128) != 0) {
+            ::close(listen_fd);
+            return false;
+        }
+
+        pollfd fds[2] = {{listen_fd, POLLIN, 0}, {stop_pipe[0], POLLIN, 0}};
+        while (true) {
+            if (::poll(fds, 2, -1) < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                break;
+            }
+            if (fds[1].revents != 0) {
+                break;
+            }
+            const int client_fd = ::accept(listen_fd, nullptr, nullptr);
+            if (client_fd >= 0) {
+                detail::DisableSigPipe(client_fd);
+                HandleConnection(client_fd);
+                ::close(client_fd);
             }
         }
-        const std::string error = "Unknown command: \"" + args.command + "\"";
-        error_stream << error;
-        return CommandOutput{error, false};
+        ::close(listen_fd);
+        ::unlink(socket_path.c_str());
+        return true;
     }
 
     /**
-     * @brief Executes a command from user input and sends output to a stream (std::cout by default) and error output to another stream (std::cerr by default)
+     * @brief Gives every command a deadline, so a client gets a timeout error instead of waiting on a runaway command,
+     *        and the next connection is handled. Call it before Serve
      *
-     * @param input The user input to parse and execute
-     * @param output_stream The stream to send output to. std::cout by default
-     * @param error_stream The stream to send error output to. std::cerr by default
-     * @return CommandOutput the output of the command or an error output if the command failed.
+     * @remark The deadline is only cooperative. Commands run inline on the single thread that handles connections, not on a
+     *         pool like the pool overload of EasyCLI::ExecuteWithTimeout, since their output streams straight to the client socket.
+     *         A command that never checks args.stop_requested() keeps its client waiting and blocks every later connection,
+     *         so this gives the server no protection from such commands
      */
-    CommandOutput ExecuteIntoStream(const std::string &input, std::ostream &output_stream = std::cout, std::ostream &error_stream = std::cerr) {
-        CommandArguments args = ParseArgs(input);
-        if (commands.find(args.command) != commands.end()) {
-            CommandOutput out = commands[args.command](args);
-            if (out.success) {
-                output_stream << out.out << std::endl;
-                return out;
-            } else {
-                error_stream << out.out << std::endl;
-            }
-        }
-        const std::string error = "Unknown command: \"" + args.command + "\"";
-        return CommandOutput{error, false};
+    void SetCommandTimeout(std::chrono::nanoseconds timeout) {
+        command_timeout = timeout;
     }
 
     /**
-     * @brief Execute a command without returning the output
-     *
-     * @param input The user input to parse and execute
+     * @brief Sets how long a client has to send its request, and to take each part of the reply, before it is dropped.
+     *        10 seconds by default. Call it before Serve
      */
-    void ExecuteVoid(const std::string &input) {
-        CommandArguments args = ParseArgs(input);
-        if (commands.find(args.command) != commands.end()) {
-            commands[args.command](args);
-        }
+    void SetRequestTimeout(std::chrono::nanoseconds timeout) {
+        request_timeout = timeout;
     }
 
     /**
-     * @brief Execute a command and modifies a string that is passed by reference with the output of the command
-     *
-     * @param input The user input to parse and execute
-     * @param output The string to modify with the output of the command
+     * @brief Makes Serve return. Safe to call from any thread or from a signal handler
      */
-    void ExecuteVoidIntoString(const std::string &input, std::string &output) {
-        CommandArguments args = ParseArgs(input);
-        if (commands.find(args.command) != commands.end()) {
-            CommandOutput out = commands[args.command](args);
-            output = out.out;
+    void Stop() {
+        const char byte = 0;
+        (void)!::write(stop_pipe[1], &byte, 1);
+    }
+
+  private:
+    void HandleConnection(int fd) {
+        // The whole request must arrive before the deadline. Each send of the reply gets the timeout on its own
+        const std::chrono::steady_clock::time_point deadline = detail::DeadlineAfter(request_timeout);
+        if (request_timeout != std::chrono::nanoseconds::max()) {
+            const auto micros = std::chrono::duration_cast<std::chrono::microseconds>(request_timeout).count();
+            timeval send_timeout{};
+            send_timeout.tv_sec = static_cast<decltype(send_timeout.tv_sec)>(micros / 1000000);
+            send_timeout.tv_usec = static_cast<decltype(send_timeout.tv_usec)>(micros % 1000000);
+            ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+        }
+        std::uint32_t argc = 0;
+        if (!detail::ReceiveAll(fd, &argc, sizeof(argc), deadline) || argc > detail::kMaxRequestArgs) {
+            return;
+        }
+        std::vector<std::string> strings(argc);
+        for (std::string &arg : strings) {
+            std::uint32_t length = 0;
+            if (!detail::ReceiveAll(fd, &length, sizeof(length), deadline) || length > detail::kMaxRequestArgLength) {
+                return;
+            }
+            arg.resize(length);
+            if (!detail::ReceiveAll(fd, &arg[0], length, deadline)) {
+                return;
+            }
+        }
+        std::vector<char *> argv;
+        argv.reserve(strings.size() + 1);
+        for (std::string &arg : strings) {
+            argv.push_back(&arg[0]);
+        }
+        argv.push_back(nullptr);
+
+        detail::SocketOutputSink sink(fd);
+        CommandOutput out = cli.ExecuteArgvIntoSink(static_cast<int>(argc), argv.data(), sink, command_timeout);
+        if (out.success) {
+            sink.Write("\n");
+            sink.Flush();
+        } else {
+            sink.Flush();
+            sink.Send(detail::kFrameError, out.out + "\n");
+        }
+        const std::uint32_t status = out.success ? 0 : 1;
+        sink.Send(detail::kFrameExit, std::string_view(reinterpret_cast<const char *>(&status), sizeof(status)));
+    }
+
+    EasyCLI &cli;
+    std::string socket_path;
+    std::chrono::nanoseconds command_timeout = std::chrono::nanoseconds::max();
+    std::chrono::nanoseconds request_timeout = std::chrono::seconds(10);
+    int stop_pipe[2] = {-1, -1};
+};
+
+/**
+ * @brief Forwards argv to an EasyCLIServer and copies its output and errors to the given streams
+ * @remark This is all a thin client needs: `int status = ForwardToServer(path, argc, argv); if (status >= 0) return status;`
+ *         and fall back to running the command locally otherwise. Only available on POSIX systems
+ *
+ * @param socket_path The path of the socket the server listens on
+ * @param argc The argc from main()
+ * @param argv The argv from main(), forwarded whole (the server skips argv[0] like Run does)
+ * @param output_stream The stream to copy the command output to. std::cout by default
+ * @param error_stream The stream to copy the command errors to. std::cerr by default
+ * @return The exit status of the command (0 on success, 1 on failure), or -1 if the server couldn't be reached
+ */
+inline int ForwardToServer(const std::string &socket_path, int argc, char **argv, std::ostream &output_stream = std::cout, std::ostream &error_stream = std::cerr) {
+    sockaddr_un address;
+    if (!detail::MakeSocketAddress(socket_path, address)) {
+        return -1;
+    }
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    detail::DisableSigPipe(fd);
+    if (::connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) {
+        ::close(fd);
+        return -1;
+    }
+
+    std::string request;
+    const std::uint32_t count = static_cast<std::uint32_t>(argc);
+    request.append(reinterpret_cast<const char *>(&count), sizeof(count));
+    for (int i = 0; i < argc; i++) {
+        const std::uint32_t length = static_cast<std::uint32_t>(std::strlen(argv[i]));
+        request.append(reinterpret_cast<const char *>(&length), sizeof(length));
+        request.append(argv[i], length);
+    }
+
+    int status = -1;
+    if (detail::SendAll(fd, request.data(), request.size())) {
+        std::string payload;
+        char kind = 0;
+        std::uint32_t length = 0;
+        while (detail::ReceiveAll(fd, &kind, 1) && detail::ReceiveAll(fd, &length, sizeof(length))) {
+            payload.resize(length);
+            if (length > 0 && !detail::ReceiveAll(fd, &payload[0], length)) {
+                break;
+            }
+            if (kind == detail::kFrameOutput) {
+                output_stream << payload;
+            } else if (kind == detail::kFrameError) {
+                error_stream << payload;
+            } else if (kind == detail::kFrameExit && length == sizeof(std::uint32_t)) {
+                std::uint32_t exit_status = 0;
+                std::memcpy(&exit_status, payload.data(), sizeof(exit_status));
+                status = static_cast<int>(exit_status);
+                break;
+            }
         }
     }
+    ::close(fd);
+    output_stream.flush();
+    return status;
+}
+#endif
+
+/**
+ * @brief A command name and function pair, used to build a StaticEasyCLI
+ */
+struct StaticCommand {
+    std::string_view name;
+    CommandOutput (*fn)(const CommandArguments &);
+};
+
+namespace detail {
+/**
+ * @brief The smallest power of two that is at least twice n, so a static table is never more than half full
+ */
+constexpr std::size_t StaticTableSize(std::size_t n) {
+    std::size_t size = 2;
+    while (size < 2 * n) {
+        size *= 2;
+    }
+    return size;
+}
+} // namespace detail
 
+/**
+ * @brief A CLI whose commands are all known at compile time
+ * @remark The hash table is built by the constexpr constructor, so a `constexpr` StaticEasyCLI costs nothing at startup
+ *         and never touches the heap. Lookups hash the name once and usually compare against a single slot
+ * @remark Build it with MakeStaticEasyCLI:
+ *         `constexpr auto cli = MakeStaticEasyCLI({StaticCommand{"multiply", multiply}, StaticCommand{"echo", echo}});`
+ *
+ * @tparam N the number of commands
+ */
+template <std::size_t N> class StaticEasyCLI {
+  public:
     /**
-     * @brief Executes a command from user input and sends error output to a stream (std::cerr by default)
+     * @brief Builds the table from a list of commands
      *
-     * @param input The user input to parse and execute
-     * @param error_stream The stream to send error output to. std::cerr by default
+     * @param list the commands. A duplicate name is a compile error in a constant expression and throws std::invalid_argument otherwise
      */
-    void ExecuteVoidWithErrStream(const std::string &input, std::ostream &error_stream = std::cerr) {
-        CommandArguments args = ParseArgs(input);
-        if (commands.find(args.command) != commands.end()) {
-            CommandOutput out = commands[args.command](args);
-            if (!out.success) {
-                error_stream << out.out << std::endl;
+    constexpr explicit StaticEasyCLI(const StaticCommand (&list)[N]) : commands{}, hashes{}, slots{} {
+        for (std::size_t i = 0; i < N; i++) {
+            commands[i] = list[i];
+            hashes[i] = detail::HashName(list[i].name);
+            std::size_t slot = hashes[i] & (table_size - 1);
+            while (slots[slot] != 0) {
+                const std::size_t other = slots[slot] - 1;
+                if (hashes[other] == hashes[i] && commands[other].name == list[i].name) {
+                    throw std::invalid_argument("StaticEasyCLI: duplicate command name");
+                }
+                slot = (slot + 1) & (table_size - 1);
             }
+            slots[slot] = static_cast<std::uint32_t>(i + 1);
         }
-        const std::string error = "Unknown command: \"" + args.command + "\"";
-        error_stream << error;
     }
 
     /**
-     * @brief Executes a command from user input and sends output to a stream (std::cout by default) and error output to another stream (std::cerr by default)
+     * @brief Looks a command up by name
      *
-     * @param input The user input to parse and execute
-     * @param output_stream The stream to send output to. std::cout by default
-     * @param error_stream The stream to send error output to. std::cerr by default
+     * @return A pointer to the command, or nullptr if there is no command with that name
      */
-    void ExecuteVoidIntoStream(const std::string &input, std::ostream &output_stream = std::cout, std::ostream &error_stream = std::cerr) {
-        CommandArguments args = ParseArgs(input);
-        if (commands.find(args.command) != commands.end()) {
-            CommandOutput output = commands[args.command](args);
-            if (output.success) {
-                output_stream << output.out << std::endl;
-            } else {
-                error_stream << output.out << std::endl;
+    constexpr const StaticCommand *Find(std::string_view name) const {
+        const std::uint64_t hash = detail::HashName(name);
+        for (std::size_t slot = hash & (table_size - 1); slots[slot] != 0; slot = (slot + 1) & (table_size - 1)) {
+            const std::size_t index = slots[slot] - 1;
+            if (hashes[index] == hash && commands[index].name == name) {
+                return &commands[index];
             }
         }
+        return nullptr;
     }
 
     /**
-     * @brief Gets a list of all the commands registered as a vector of strings
+     * @brief Executes a command from user input and returns the output
      *
-     * @return A vector of strings containing all the commands
+     * @param input The user input to parse and execute
+     * @return CommandOutput The output of the command or an error output if the command failed.
      */
-    std::vector<std::string> GetCommandsString() const {
-        std::vector<std::string> command_list;
-        for (const auto &command : commands) {
-            command_list.push_back(command.first);
+    CommandOutput Execute(const std::string &input) const {
+        const detail::ArgumentsLease lease;
+        CommandArguments &args = lease.Parse(input);
+        if (const StaticCommand *command = Find(args.command)) {
+            return command->fn(args);
         }
-        return command_list;
+        return detail::UnknownCommand(args.command);
     }
 
     /**
-     * @brief gets a list of all the commands registered as a vector of CommandFunction
+     * @brief Executes a command straight from argv and returns the output
      *
-     * @return a vector of CommandFunction containing all the commands
+     * @param argc The argc from main()
+     * @param argv The argv from main(). argv[0] (the program name) is skipped
+     * @return CommandOutput The output of the command or an error output if the command failed.
      */
-    std::vector<CommandFunction> GetCommands() const {
-        std::vector<CommandFunction> command_list;
-        for (const auto &command : commands) {
-            command_list.push_back(command.second);
+    CommandOutput ExecuteArgv(int argc, char **argv) const {
+        CommandArgumentsView view;
+        ParseArgv(argc, argv, view);
+        if (const StaticCommand *command = Find(view.command)) {
+            return command->fn(view.ToCommandArguments());
         }
-        return command_list;
+        return detail::UnknownCommand(view.command);
     }
 
     /**
-     * @brief Sugar for ExecuteVoidIntoStream that takes argv as input and not a string
-     *
-     * @param argv the argv array from main()
+     * @brief Same as EasyCLI::Run: executes a command from argv, sending output to std::cout and errors to std::cerr
      */
-    void Run(char **argv, bool cout_output = true, bool cerr_output = true) {
-        if (argv[1] != nullptr) {
-            std::string input = "";
-            argv++; // Skip the first argument
-            while (*argv != nullptr) {
-                input += *argv;
-                input += " ";
-                argv++;
-            }
-            ExecuteVoidIntoStream(input);
+    void Run(int argc, char **argv) const {
+        if (argc > 1) {
+            CommandOutput out = ExecuteArgv(argc, argv);
+            (out.success ? std::cout : std::cerr) << out.out << std::endl;
         } else {
             std::cerr << "Available commands:" << std::endl;
-            for (const auto &command : GetCommandsString()) {
-                std::cerr << "\t- " << command << std::endl;
+            for (const StaticCommand &command : commands) {
+                std::cerr << "\t- " << command.name << std::endl;
             }
         }
     }
 
-  protected:
-    CommandMap commands;
-};
\ No newline at end of file
+    /**
+     * @brief Gets the registered commands, in the order they were given
+     */
+    constexpr const std::array<StaticCommand, N> &GetCommands() const {
+        return commands;
+    }
+
+  private:
+    static constexpr std::size_t table_size = detail::StaticTableSize(N);
+
+    std::array<StaticCommand, N> commands;
+    std::array<std::uint64_t, N> hashes;
+    // Index + 1 of the command in each slot, 0 for an empty slot
+    std::array<std::uint32_t, table_size> slots;
+};
+
+/**
+ * @brief Builds a StaticEasyCLI, deducing the number of commands
+ *
+ * @param list the commands, e.g. `{StaticCommand{"multiply", multiply}, StaticCommand{"echo", echo}}`
+ */
+template <std::size_t N> constexpr StaticEasyCLI<N> MakeStaticEasyCLI(const StaticCommand (&list)[N]) {
+    return StaticEasyCLI<N>(list);
+}
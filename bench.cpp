@@ -0,0 +1,803 @@
+#include "EasyCLI.hpp"
+#include <atomic>
+#include <benchmark/benchmark.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#ifdef EASYCLI_POSIX
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#endif
+
+// Counts calls to the global allocator, so benchmarks can report allocations per call
+static std::atomic<std::size_t> allocation_count{0};
+
+// GCC sees the malloc and free of these through inlining, and would flag every delete expression as mismatched
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void *operator new(std::size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    if (void *ptr = std::malloc(size != 0 ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+// Reports the allocations made while it is alive as an allocs_per_call counter
+class AllocationCounter {
+  public:
+    explicit AllocationCounter(benchmark::State &state) : state(state), start(allocation_count.load()) {
+    }
+
+    ~AllocationCounter() {
+        const double allocations = static_cast<double>(allocation_count.load() - start);
+        state.counters["allocs_per_call"] = benchmark::Counter(allocations, benchmark::Counter::kAvgIterations);
+    }
+
+  private:
+    benchmark::State &state;
+    std::size_t start;
+};
+
+// A stream that discards everything, for the Execute* variants that write to streams
+class NullBuffer : public std::streambuf {
+  protected:
+    int overflow(int c) override {
+        return c;
+    }
+
+    std::streamsize xsputn(const char *, std::streamsize count) override {
+        return count;
+    }
+};
+static NullBuffer null_buffer;
+static std::ostream null_stream(&null_buffer);
+
+// The istringstream-based parser EasyCLI used before the string_view tokenizer, kept as a baseline
+static CommandArguments ParseArgsIstringstream(const std::string &input) {
+    CommandArguments args;
+    std::istringstream iss(input);
+    std::string token;
+    iss >> args.command;
+    while (iss >> token) {
+        if (token[0] == '-') {
+            args.flags.push_back(token.substr(1));
+        } else {
+            args.arguments.push_back(token);
+        }
+    }
+    return args;
+}
+
+// "cp" followed by `count` file paths and a flag every 8 tokens, like the long file lists of batch jobs
+static std::string MakeInput(std::size_t count) {
+    std::string input = "cp";
+    for (std::size_t i = 0; i < count; i++) {
+        input += (i % 8 == 7) ? " -verbose" : " /var/data/batch/input_file_" + std::to_string(i) + ".dat";
+    }
+    return input;
+}
+
+static void BM_ParseArgsIstringstream(benchmark::State &state) {
+    const std::string input = MakeInput(static_cast<std::size_t>(state.range(0)));
+    AllocationCounter allocations(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(ParseArgsIstringstream(input));
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * input.size()));
+}
+BENCHMARK(BM_ParseArgsIstringstream)->Arg(1)->Arg(4)->Arg(64)->Arg(1024);
+
+static void BM_ParseArgs(benchmark::State &state) {
+    const std::string input = MakeInput(static_cast<std::size_t>(state.range(0)));
+    AllocationCounter allocations(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(ParseArgs(input));
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * input.size()));
+}
+BENCHMARK(BM_ParseArgs)->Arg(1)->Arg(4)->Arg(64)->Arg(1024);
+
+// Parses into the same CommandArguments every time, like the Execute* variants do
+static void BM_ParseArgsReused(benchmark::State &state) {
+    const std::string input = MakeInput(static_cast<std::size_t>(state.range(0)));
+    CommandArguments args;
+    AllocationCounter allocations(state);
+    for (auto _ : state) {
+        ParseArgs(input, args);
+        benchmark::DoNotOptimize(args.arguments.data());
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * input.size()));
+}
+BENCHMARK(BM_ParseArgsReused)->Arg(1)->Arg(4)->Arg(64)->Arg(1024);
+
+static void BM_ParseArgsView(benchmark::State &state) {
+    const std::string input = MakeInput(static_cast<std::size_t>(state.range(0)));
+    CommandArgumentsView args;
+    AllocationCounter allocations(state);
+    for (auto _ : state) {
+        ParseArgsView(input, args);
+        benchmark::DoNotOptimize(args.arguments.data());
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * input.size()));
+}
+BENCHMARK(BM_ParseArgsView)->Arg(1)->Arg(4)->Arg(64)->Arg(1024);
+
+// A command followed by state.range(0) short flags, like "build -v -g -O2 ..."
+static void BM_ParseArgsManyFlags(benchmark::State &state) {
+    std::string input = "build";
+    for (int64_t i = 0; i < state.range(0); i++) {
+        input += " -f" + std::to_string(i);
+    }
+    AllocationCounter allocations(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(ParseArgs(input));
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * input.size()));
+}
+BENCHMARK(BM_ParseArgsManyFlags)->Arg(4)->Arg(32)->Arg(256);
+
+// Counts the tokens of a long input with a given scanner, to compare the scalar and SIMD boundary scans
+static void ScanTokens(benchmark::State &state, detail::ScanFunction scan) {
+    const std::string input = MakeInput(1024);
+    for (auto _ : state) {
+        std::size_t pos = 0;
+        std::size_t tokens = 0;
+        while ((pos = scan(input.data(), pos, input.size(), false)) < input.size()) {
+            pos = scan(input.data(), pos, input.size(), true);
+            tokens++;
+        }
+        benchmark::DoNotOptimize(tokens);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * input.size()));
+}
+BENCHMARK_CAPTURE(ScanTokens, Scalar, detail::ScanScalar);
+BENCHMARK_CAPTURE(ScanTokens, Dispatched, detail::GetScanFunction());
+#ifdef EASYCLI_SIMD_X86
+BENCHMARK_CAPTURE(ScanTokens, Sse2, detail::ScanSse2);
+#endif
+
+static CommandOutput Noop(const CommandArguments &) {
+    return CommandOutput{"", true};
+}
+
+// Checks the last of state.range(0) flags, by searching the flags vector and by the declared flag's bit
+static void FlagLookup(benchmark::State &state, bool declared) {
+    std::vector<std::string> names;
+    for (int64_t i = 0; i < state.range(0); i++) {
+        names.push_back("f" + std::to_string(i));
+    }
+    std::string input = "build";
+    for (const std::string &name : names) {
+        input += " -" + name;
+    }
+    CommandArguments args = ParseArgs(input);
+    CommandFunction fn = Noop;
+    if (declared) {
+        fn.SetKnownFlags(std::make_shared<const FlagSet>(names));
+    }
+    detail::ResolveFlags(args, fn);
+    const std::string last = names.back();
+    const std::size_t last_index = names.size() - 1;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(declared ? args.flags_contains(last_index) : args.flags_contains(last));
+    }
+}
+BENCHMARK_CAPTURE(FlagLookup, Search, false)->Arg(4)->Arg(32)->Arg(64);
+BENCHMARK_CAPTURE(FlagLookup, Bit, true)->Arg(4)->Arg(32)->Arg(64);
+
+// Calls a stored command the way Execute does, to compare std::function with CommandFunction per dispatch
+template <typename Function> static void InvokeCommand(benchmark::State &state, Function fn) {
+    CommandArguments args = ParseArgs("noop a b -c");
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(fn(args));
+    }
+}
+
+// A lambda with a 24-byte capture, which std::function stores on the heap
+static auto MakeCapturingLambda() {
+    std::array<const char *, 3> capture = {"", "", ""};
+    return [capture](const CommandArguments &) { return CommandOutput{capture[0], true}; };
+}
+
+BENCHMARK_CAPTURE(InvokeCommand, StdFunctionPointer, std::function<CommandOutput(const CommandArguments &)>(Noop));
+BENCHMARK_CAPTURE(InvokeCommand, CommandFunctionPointer, CommandFunction(Noop));
+BENCHMARK_CAPTURE(InvokeCommand, StdFunctionLambda, std::function<CommandOutput(const CommandArguments &)>(MakeCapturingLambda()));
+BENCHMARK_CAPTURE(InvokeCommand, CommandFunctionLambda, CommandFunction(MakeCapturingLambda()));
+
+// Copies a capturing lambda into the callable type, like RegisterCommand does
+template <typename Function> static void StoreCommand(benchmark::State &state) {
+    const auto lambda = MakeCapturingLambda();
+    for (auto _ : state) {
+        Function fn(lambda);
+        benchmark::DoNotOptimize(fn);
+    }
+}
+BENCHMARK_TEMPLATE(StoreCommand, std::function<CommandOutput(const CommandArguments &)>);
+BENCHMARK_TEMPLATE(StoreCommand, CommandFunction);
+
+static EasyCLI &SharedCli() {
+    static EasyCLI cli = [] {
+        EasyCLI cli;
+        cli.RegisterCommand("noop", Noop);
+        cli.EnableConcurrentAccess();
+        return cli;
+    }();
+    return cli;
+}
+
+// Execute from many threads in concurrent mode, which reads registry snapshots without locking
+static void BM_ConcurrentExecute(benchmark::State &state) {
+    EasyCLI &cli = SharedCli();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(cli.Execute("noop a b -c"));
+    }
+}
+BENCHMARK(BM_ConcurrentExecute)->ThreadRange(1, 8)->UseRealTime();
+
+// The same with every call behind one global mutex, which is what callers had to do before
+static void BM_MutexExecute(benchmark::State &state) {
+    static std::mutex mutex;
+    EasyCLI &cli = SharedCli();
+    for (auto _ : state) {
+        std::lock_guard<std::mutex> lock(mutex);
+        benchmark::DoNotOptimize(cli.Execute("noop a b -c"));
+    }
+}
+BENCHMARK(BM_MutexExecute)->ThreadRange(1, 8)->UseRealTime();
+
+// A replay of 10k independent commands, one Execute at a time versus ExecuteBatch on a pool with state.range(0) threads
+static std::vector<std::string> MakeReplay() {
+    std::vector<std::string> lines;
+    for (int i = 0; i < 10000; i++) {
+        lines.push_back("noop " + std::to_string(i) + " -flag");
+    }
+    return lines;
+}
+
+static CommandOutput Multiply(const CommandArguments &args) {
+    return CommandOutput{std::to_string(std::stoi(args.arguments[0]) * std::stoi(args.arguments[1])), true};
+}
+
+// Execute against a registry of state.range(0) commands
+static void BM_ExecuteRegistrySize(benchmark::State &state) {
+    EasyCLI cli;
+    const int64_t size = state.range(0);
+    for (int64_t i = 0; i < size; i++) {
+        cli.RegisterCommand("command_" + std::to_string(i), Noop);
+    }
+    const std::string input = "command_" + std::to_string(size / 2) + " a b -c";
+    AllocationCounter allocations(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(cli.Execute(input));
+    }
+}
+BENCHMARK(BM_ExecuteRegistrySize)->RangeMultiplier(10)->Range(10, 100000);
+
+// StaticEasyCLI needs its commands listed at compile time, so only a small table is measured
+static void BM_StaticExecute(benchmark::State &state) {
+    static constexpr auto cli = MakeStaticEasyCLI({StaticCommand{"noop", Noop}, StaticCommand{"multiply", Multiply}});
+    AllocationCounter allocations(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(cli.Execute("multiply 6 7"));
+    }
+}
+BENCHMARK(BM_StaticExecute);
+
+// "multiply 6 7" prepared once, then executed without parsing or looking it up
+static void BM_PreparedExecute(benchmark::State &state) {
+    EasyCLI cli;
+    cli.RegisterCommand("multiply", Multiply);
+    PreparedCommand prepared = cli.Prepare("multiply 6 7");
+    AllocationCounter allocations(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(prepared.Execute());
+    }
+}
+BENCHMARK(BM_PreparedExecute);
+
+// One call of an Execute* variant per iteration, on "multiply 6 7" with the output discarded
+template <typename Call> static void ExecuteVariant(benchmark::State &state, Call call) {
+    EasyCLI cli;
+    cli.RegisterCommand("multiply", Multiply);
+    AllocationCounter allocations(state);
+    for (auto _ : state) {
+        call(cli);
+    }
+}
+
+static std::string variant_output;
+static detail::NullOutputSink null_sink;
+static char argv_program[] = "app", argv_command[] = "multiply", argv_a[] = "6", argv_b[] = "7";
+static char *variant_argv[] = {argv_program, argv_command, argv_a, argv_b, nullptr};
+
+BENCHMARK_CAPTURE(ExecuteVariant, Execute, [](EasyCLI &cli) { benchmark::DoNotOptimize(cli.Execute("multiply 6 7")); });
+BENCHMARK_CAPTURE(ExecuteVariant, ExecuteWithErrStream, [](EasyCLI &cli) { benchmark::DoNotOptimize(cli.ExecuteWithErrStream("multiply 6 7", null_stream)); });
+BENCHMARK_CAPTURE(ExecuteVariant, ExecuteIntoStream, [](EasyCLI &cli) { benchmark::DoNotOptimize(cli.ExecuteIntoStream("multiply 6 7", null_stream, null_stream)); });
+BENCHMARK_CAPTURE(ExecuteVariant, ExecuteIntoSink, [](EasyCLI &cli) { benchmark::DoNotOptimize(cli.ExecuteIntoSink("multiply 6 7", null_sink, null_stream)); });
+BENCHMARK_CAPTURE(ExecuteVariant, ExecuteVoid, [](EasyCLI &cli) { cli.ExecuteVoid("multiply 6 7"); });
+BENCHMARK_CAPTURE(ExecuteVariant, ExecuteVoidIntoString, [](EasyCLI &cli) { cli.ExecuteVoidIntoString("multiply 6 7", variant_output); });
+BENCHMARK_CAPTURE(ExecuteVariant, ExecuteVoidWithErrStream, [](EasyCLI &cli) { cli.ExecuteVoidWithErrStream("multiply 6 7", null_stream); });
+BENCHMARK_CAPTURE(ExecuteVariant, ExecuteVoidIntoStream, [](EasyCLI &cli) { cli.ExecuteVoidIntoStream("multiply 6 7", null_stream, null_stream); });
+BENCHMARK_CAPTURE(ExecuteVariant, ExecuteArgv, [](EasyCLI &cli) { benchmark::DoNotOptimize(cli.ExecuteArgv(4, variant_argv)); });
+BENCHMARK_CAPTURE(ExecuteVariant, ExecuteArgvIntoSink, [](EasyCLI &cli) { benchmark::DoNotOptimize(cli.ExecuteArgvIntoSink(4, variant_argv, null_sink)); });
+BENCHMARK_CAPTURE(ExecuteVariant, Run, [](EasyCLI &cli) {
+    std::streambuf *cout_buffer = std::cout.rdbuf(&null_buffer);
+    cli.Run(4, variant_argv);
+    std::cout.rdbuf(cout_buffer);
+});
+BENCHMARK_CAPTURE(ExecuteVariant, UnknownCommand, [](EasyCLI &cli) { benchmark::DoNotOptimize(cli.Execute("divide 6 7")); });
+
+// Execute with EnableInstrumentation, to compare with ExecuteVariant/Execute
+static void BM_ExecuteInstrumented(benchmark::State &state) {
+    EasyCLI cli;
+    cli.RegisterCommand("multiply", Multiply);
+    cli.EnableInstrumentation();
+    AllocationCounter allocations(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(cli.Execute("multiply 6 7"));
+    }
+}
+BENCHMARK(BM_ExecuteInstrumented);
+
+#ifdef EASYCLI_POSIX
+// Sends the output of one command per iteration to a file: flushed per command by ExecuteIntoStream,
+// one write per command with FdOutputSink, and batched writev calls with BufferedOutputSink
+static void BM_OutputToFile(benchmark::State &state, int mode) {
+    EasyCLI cli;
+    cli.RegisterCommand("multiply", Multiply);
+    const int fd = ::open("/dev/null", O_WRONLY);
+    std::ofstream stream("/dev/null");
+    FdOutputSink unbuffered(fd);
+    BufferedOutputSink buffered(fd);
+    for (auto _ : state) {
+        if (mode == 0) {
+            cli.ExecuteIntoStream("multiply 6 7", stream);
+        } else if (mode == 1) {
+            cli.ExecuteIntoSink("multiply 6 7", unbuffered);
+        } else {
+            cli.ExecuteIntoSink("multiply 6 7", buffered);
+        }
+    }
+    buffered.Flush();
+    ::close(fd);
+}
+BENCHMARK_CAPTURE(BM_OutputToFile, StreamEndl, 0);
+BENCHMARK_CAPTURE(BM_OutputToFile, FdSink, 1);
+BENCHMARK_CAPTURE(BM_OutputToFile, Buffered, 2);
+#endif
+
+// A 100k-line script, run through a std::getline loop around ExecuteIntoStream and through RunStream
+static std::string MakeScript() {
+    std::string script;
+    for (int i = 0; i < 100000; i++) {
+        script += "multiply " + std::to_string(i % 100) + " 7\n";
+    }
+    return script;
+}
+
+static void BM_ScriptGetline(benchmark::State &state) {
+    EasyCLI cli;
+    cli.RegisterCommand("multiply", Multiply);
+    const std::string script = MakeScript();
+    for (auto _ : state) {
+        std::istringstream input(script);
+        std::string line;
+        while (std::getline(input, line)) {
+            cli.ExecuteIntoStream(line, null_stream, null_stream);
+        }
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * script.size()));
+}
+BENCHMARK(BM_ScriptGetline)->Unit(benchmark::kMillisecond);
+
+static void BM_ScriptRunStream(benchmark::State &state) {
+    EasyCLI cli;
+    cli.RegisterCommand("multiply", Multiply);
+    const std::string script = MakeScript();
+    for (auto _ : state) {
+        std::istringstream input(script);
+        cli.RunStream(input, null_stream, null_stream);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * script.size()));
+}
+BENCHMARK(BM_ScriptRunStream)->Unit(benchmark::kMillisecond);
+
+// The same script run from a file, serially and in parallel chunks
+static void BM_ScriptExecuteFile(benchmark::State &state) {
+    EasyCLI cli;
+    cli.RegisterCommand("multiply", Multiply);
+    const std::string script = MakeScript();
+    const std::string path = "easycli_bench_script.txt";
+    std::ofstream(path, std::ios::binary) << script;
+    std::unique_ptr<WorkStealingPool> pool;
+    if (state.range(0) > 0) {
+        pool = std::make_unique<WorkStealingPool>(static_cast<std::size_t>(state.range(0)));
+    }
+    for (auto _ : state) {
+        if (pool) {
+            cli.ExecuteFile(path, *pool, null_stream, null_stream);
+        } else {
+            cli.ExecuteFile(path, null_stream, null_stream);
+        }
+    }
+    std::remove(path.c_str());
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * script.size()));
+}
+BENCHMARK(BM_ScriptExecuteFile)->Arg(0)->Arg(2)->Arg(4)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Runs `cluster node drain n1 -force` through groups, and like a hand-written group that joins the rest of the line
+// and executes it again on a nested EasyCLI, re-tokenizing it at every level
+static void NestedDispatch(benchmark::State &state, bool groups) {
+    EasyCLI cli;
+    EasyCLI cluster;
+    EasyCLI node;
+    if (groups) {
+        cli.RegisterGroup("cluster").RegisterGroup("node").RegisterCommand("drain", Noop);
+    } else {
+        const auto forward = [](EasyCLI &next) {
+            return [&next](const CommandArguments &args) {
+                std::string rest;
+                for (const std::string &argument : args.arguments) {
+                    rest += argument + ' ';
+                }
+                for (const std::string &flag : args.flags) {
+                    rest += '-' + flag + ' ';
+                }
+                return next.Execute(rest);
+            };
+        };
+        node.RegisterCommand("drain", Noop);
+        cluster.RegisterCommand("node", forward(node));
+        cli.RegisterCommand("cluster", forward(cluster));
+    }
+    const std::string input = "cluster node drain n1 -force";
+    AllocationCounter allocations(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(cli.Execute(input));
+    }
+}
+BENCHMARK_CAPTURE(NestedDispatch, Reparse, false);
+BENCHMARK_CAPTURE(NestedDispatch, Groups, true);
+
+#ifdef EASYCLI_COROUTINES
+// Runs commands that each wait 1ms: as coroutines in flight together on one event loop thread, and as blocking commands
+// with a thread each, which is what it takes to have them in flight together without coroutines
+static CommandTask SleepAsync(const CommandArguments &) {
+    co_await SleepFor(std::chrono::milliseconds(1));
+    co_return CommandOutput{"", true};
+}
+
+static CommandOutput SleepBlocking(const CommandArguments &) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    return CommandOutput{"", true};
+}
+
+static void SlowCommands(benchmark::State &state, bool coroutines) {
+    EasyCLI cli;
+    if (coroutines) {
+        cli.RegisterCommand("sleep", SleepAsync);
+    } else {
+        cli.RegisterCommand("sleep", SleepBlocking);
+    }
+    for (auto _ : state) {
+        if (coroutines) {
+            EventLoop loop;
+            for (int i = 0; i < state.range(0); i++) {
+                cli.ExecuteAsync("sleep", loop, nullptr);
+            }
+            loop.Run();
+        } else {
+            std::vector<std::thread> threads;
+            for (int i = 0; i < state.range(0); i++) {
+                threads.emplace_back([&cli] { cli.Execute("sleep"); });
+            }
+            for (std::thread &thread : threads) {
+                thread.join();
+            }
+        }
+    }
+}
+BENCHMARK_CAPTURE(SlowCommands, ThreadPerCommand, false)->Arg(100)->Arg(1000)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK_CAPTURE(SlowCommands, EventLoop, true)->Arg(100)->Arg(1000)->Unit(benchmark::kMillisecond)->UseRealTime();
+#endif
+
+// A command that does 50 ms of work in 1 ms slices, checking between slices whether it should stop
+static CommandOutput Stall(const CommandArguments &args) {
+    const auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(50);
+    while (std::chrono::steady_clock::now() < end && !args.stop_requested()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return CommandOutput{"", true};
+}
+
+// Runs 100 commands, of which every 20th stalls, with no limit and with a 2 ms timeout, and reports the slowest call
+static void StallingCommands(benchmark::State &state, bool bounded) {
+    EasyCLI cli;
+    cli.RegisterCommand("noop", Noop);
+    cli.RegisterCommand("stall", Stall);
+    std::chrono::steady_clock::duration slowest{};
+    for (auto _ : state) {
+        for (int i = 0; i < 100; i++) {
+            const char *input = i % 20 == 19 ? "stall" : "noop";
+            const auto start = std::chrono::steady_clock::now();
+            benchmark::DoNotOptimize(bounded ? cli.ExecuteWithTimeout(input, std::chrono::milliseconds(2)) : cli.Execute(input));
+            slowest = std::max(slowest, std::chrono::steady_clock::now() - start);
+        }
+    }
+    state.counters["max_ms"] = std::chrono::duration<double, std::milli>(slowest).count();
+}
+BENCHMARK_CAPTURE(StallingCommands, NoLimit, false)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK_CAPTURE(StallingCommands, Timeout, true)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// The cost of giving a fast command a deadline
+static void BM_ExecuteWithTimeout(benchmark::State &state) {
+    EasyCLI cli;
+    cli.RegisterCommand("noop", Noop);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(cli.ExecuteWithTimeout("noop a b", std::chrono::seconds(1)));
+    }
+}
+BENCHMARK(BM_ExecuteWithTimeout);
+
+// Lines for the pipeline benchmark: with a pipeline they come from args.input, otherwise from the arguments after the first
+template <typename F> static void ForEachInputLine(const CommandArguments &args, F f) {
+    if (args.input != nullptr) {
+        LineReader lines(*args.input);
+        std::string_view line;
+        while (lines.Next(line)) {
+            f(line);
+        }
+    } else {
+        for (std::size_t i = 1; i < args.arguments.size(); i++) {
+            f(args.arguments[i]);
+        }
+    }
+}
+
+static CommandOutput Generate(const CommandArguments &args, OutputSink &out) {
+    const int n = std::stoi(args.arguments.at(0));
+    for (int i = 1; i <= n; i++) {
+        out.Write(std::to_string(i));
+        out.Write("\n");
+    }
+    return CommandOutput{"", true};
+}
+
+static CommandOutput Filter(const CommandArguments &args, OutputSink &out) {
+    const std::string &pattern = args.arguments.at(0);
+    ForEachInputLine(args, [&](std::string_view line) {
+        if (line.find(pattern) != std::string_view::npos) {
+            out.Write(line);
+            out.Write("\n");
+        }
+    });
+    return CommandOutput{"", true};
+}
+
+static CommandOutput CountLines(const CommandArguments &args) {
+    std::size_t count = 0;
+    ForEachInputLine(args, [&count](std::string_view) { count++; });
+    return CommandOutput{std::to_string(count), true};
+}
+
+// generate 100000 | filter 7 | filter 3 | count: as a pipeline, and by passing each output in the input string of the next
+// Execute call like callers did before pipelines. Reports the largest output held between two commands, which for the
+// pipeline is the most its queue between two commands can hold
+static void ChainCommands(benchmark::State &state, bool pipeline) {
+    EasyCLI cli;
+    cli.RegisterCommand("generate", Generate);
+    cli.RegisterCommand("filter", Filter);
+    cli.RegisterCommand("count", CountLines);
+    std::size_t largest = 0;
+    for (auto _ : state) {
+        if (pipeline) {
+            benchmark::DoNotOptimize(cli.ExecutePipeline("generate 100000 | filter 7 | filter 3 | count"));
+            largest = detail::kPipeQueueChunks * detail::kPipeChunkBytes;
+        } else {
+            std::string out = cli.Execute("generate 100000").out;
+            largest = std::max(largest, out.size());
+            out = cli.Execute("filter 7 " + out).out;
+            out = cli.Execute("filter 3 " + out).out;
+            benchmark::DoNotOptimize(cli.Execute("count x " + out));
+        }
+    }
+    state.counters["held_bytes"] = static_cast<double>(largest);
+}
+BENCHMARK_CAPTURE(ChainCommands, ReparseOutput, false)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK_CAPTURE(ChainCommands, Pipeline, true)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Completes a prefix shared by 11 of 5000 commands, with the trie and by scanning every name like a hand-written helper would
+static void CompletePrefix(benchmark::State &state, bool trie) {
+    EasyCLI cli;
+    for (int i = 0; i < 5000; i++) {
+        cli.RegisterCommand("command" + std::to_string(i), Noop);
+    }
+    const std::string prefix = "command123";
+    for (auto _ : state) {
+        if (trie) {
+            benchmark::DoNotOptimize(cli.Complete(prefix));
+        } else {
+            std::vector<std::string> matches;
+            for (const std::string &name : cli.GetCommandsString()) {
+                if (name.compare(0, prefix.size(), prefix) == 0) {
+                    matches.push_back(name);
+                }
+            }
+            benchmark::DoNotOptimize(matches);
+        }
+    }
+    state.counters["index_bytes"] = static_cast<double>(cli.GetIndexMemoryUsage());
+}
+BENCHMARK_CAPTURE(CompletePrefix, Scan, false);
+BENCHMARK_CAPTURE(CompletePrefix, Trie, true);
+
+// Suggests names for a misspelling among 5000 random command names: with the spelling index, and by computing a classic
+// Levenshtein distance to every name like a hand-written helper would
+static void SuggestNames(benchmark::State &state, bool indexed) {
+    EasyCLI cli;
+    std::uint32_t seed = 42;
+    std::string misspelled;
+    for (int i = 0; i < 5000; i++) {
+        std::string name;
+        seed = seed * 1103515245 + 12345;
+        const std::size_t length = 5 + (seed >> 16) % 8;
+        for (std::size_t j = 0; j < length; j++) {
+            seed = seed * 1103515245 + 12345;
+            name += static_cast<char>('a' + (seed >> 16) % 26);
+        }
+        if (i == 2500) {
+            misspelled = name;
+            std::swap(misspelled[1], misspelled[2]);
+        }
+        cli.RegisterCommand(name, Noop);
+    }
+    for (auto _ : state) {
+        if (indexed) {
+            benchmark::DoNotOptimize(cli.Suggest(misspelled));
+        } else {
+            std::vector<std::pair<std::size_t, std::string>> found;
+            for (const std::string &name : cli.GetCommandsString()) {
+                std::vector<std::size_t> row(name.size() + 1);
+                for (std::size_t i = 0; i < row.size(); i++) {
+                    row[i] = i;
+                }
+                for (std::size_t j = 0; j < misspelled.size(); j++) {
+                    std::size_t diagonal = row[0];
+                    row[0] = j + 1;
+                    for (std::size_t i = 1; i < row.size(); i++) {
+                        const std::size_t above = row[i];
+                        row[i] = std::min({row[i] + 1, row[i - 1] + 1, diagonal + (name[i - 1] == misspelled[j] ? 0 : 1)});
+                        diagonal = above;
+                    }
+                }
+                if (row.back() <= 2) {
+                    found.emplace_back(row.back(), name);
+                }
+            }
+            std::sort(found.begin(), found.end());
+            benchmark::DoNotOptimize(found);
+        }
+    }
+}
+BENCHMARK_CAPTURE(SuggestNames, Scan, false)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(SuggestNames, Index, true)->Unit(benchmark::kMicrosecond);
+
+static void BM_ReplaySerial(benchmark::State &state) {
+    EasyCLI &cli = SharedCli();
+    const std::vector<std::string> lines = MakeReplay();
+    for (auto _ : state) {
+        for (const std::string &line : lines) {
+            benchmark::DoNotOptimize(cli.Execute(line));
+        }
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * lines.size()));
+}
+BENCHMARK(BM_ReplaySerial)->Unit(benchmark::kMillisecond);
+
+static void BM_ReplayBatch(benchmark::State &state) {
+    EasyCLI &cli = SharedCli();
+    const std::vector<std::string> lines = MakeReplay();
+    WorkStealingPool pool(static_cast<std::size_t>(state.range(0)));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(cli.ExecuteBatch(lines, pool));
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * lines.size()));
+}
+BENCHMARK(BM_ReplayBatch)->RangeMultiplier(2)->Range(1, 8)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+#ifdef EASYCLI_POSIX
+static const char *self_path = nullptr;
+
+static CommandOutput Echo(const CommandArguments &args) {
+    std::string out;
+    for (const std::string &arg : args.arguments) {
+        out += arg;
+    }
+    return CommandOutput{out, true};
+}
+
+static void RegisterDaemonCommands(EasyCLI &cli) {
+    cli.RegisterCommand("echo", Echo);
+}
+
+// One invocation the current way: a fresh process that registers its commands and calls Run(argv)
+static void BM_SpawnRun(benchmark::State &state) {
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    char oneshot[] = "--oneshot", command[] = "echo", argument[] = "hello";
+    char *argv[] = {const_cast<char *>(self_path), oneshot, command, argument, nullptr};
+    for (auto _ : state) {
+        pid_t pid;
+        if (posix_spawn(&pid, self_path, &actions, nullptr, argv, nullptr) != 0) {
+            state.SkipWithError("posix_spawn failed");
+            break;
+        }
+        int status;
+        waitpid(pid, &status, 0);
+    }
+    posix_spawn_file_actions_destroy(&actions);
+}
+BENCHMARK(BM_SpawnRun)->Unit(benchmark::kMicrosecond);
+
+// One invocation through a warm EasyCLIServer, which is what a thin client pays
+static void BM_ForwardToServer(benchmark::State &state) {
+    EasyCLI cli;
+    RegisterDaemonCommands(cli);
+    const std::string socket_path = "/tmp/easycli_bench_" + std::to_string(::getpid()) + ".sock";
+    EasyCLIServer server(cli, socket_path);
+    std::thread thread([&] { server.Serve(); });
+    char program[] = "client", command[] = "echo", argument[] = "hello";
+    char *argv[] = {program, command, argument, nullptr};
+    std::ostringstream out, err;
+    while (ForwardToServer(socket_path, 3, argv, out, err) < 0) {
+        std::this_thread::yield();
+    }
+    for (auto _ : state) {
+        out.str("");
+        benchmark::DoNotOptimize(ForwardToServer(socket_path, 3, argv, out, err));
+    }
+    server.Stop();
+    thread.join();
+}
+BENCHMARK(BM_ForwardToServer)->Unit(benchmark::kMicrosecond);
+#endif
+
+int main(int argc, char **argv) {
+#ifdef EASYCLI_POSIX
+    // BM_SpawnRun re-executes this binary as a one-shot CLI
+    if (argc > 1 && std::strcmp(argv[1], "--oneshot") == 0) {
+        EasyCLI cli;
+        RegisterDaemonCommands(cli);
+        cli.Run(argc - 1, argv + 1);
+        return 0;
+    }
+    self_path = argv[0];
+#endif
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -1,5 +1,38 @@
 #include "EasyCLI.hpp"
 #include <gtest/gtest.h>
+#include <atomic>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <thread>
+
+// Counts calls to the global allocator, so tests can check that a path doesn't allocate
+static std::atomic<std::size_t> allocation_count{0};
+
+// GCC sees the malloc and free of these through inlining, and would flag every delete expression as mismatched
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void *operator new(std::size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    if (void *ptr = std::malloc(size != 0 ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
 
 COMMAND_FUNCTION(multiply) {
     CommandOutput out;
@@ -74,6 +107,7 @@ COMMAND_FUNCTION(flag) {
         } else {
             out.out = "Flag is not set";
         }
+        out.success = true;
     } catch (std::exception &e) {
         out.out = e.what();
         out.success = false;
@@ -103,6 +137,1202 @@ TEST(EasyCliTest, GetCommandsStringTest) {
     EXPECT_TRUE(contains_multiply);
 }
 
+TEST(EasyCliTest, ParseArgsViewTest) {
+    const std::string input = "  echo hello\tworld -oneline   -  ";
+    CommandArgumentsView view = ParseArgsView(input);
+    EXPECT_EQ(view.command, "echo");
+    ASSERT_EQ(view.arguments.size(), 2u);
+    EXPECT_EQ(view.arguments[0], "hello");
+    EXPECT_EQ(view.arguments[1], "world");
+    ASSERT_EQ(view.flags.size(), 2u);
+    EXPECT_EQ(view.flags[0], "oneline");
+    EXPECT_EQ(view.flags[1], "");
+    EXPECT_EQ(view.arguments[0].data(), input.data() + input.find("hello"));
+
+    CommandArguments args = ParseArgs(input);
+    CommandArguments copied = view.ToCommandArguments();
+    EXPECT_EQ(args.command, copied.command);
+    EXPECT_EQ(args.arguments, copied.arguments);
+    EXPECT_EQ(args.flags, copied.flags);
+
+    ParseArgsView("   ", view);
+    EXPECT_TRUE(view.command.empty());
+    EXPECT_TRUE(view.arguments.empty());
+    EXPECT_TRUE(view.flags.empty());
+}
+
+TEST(EasyCliTest, ScanFunctionTest) {
+    std::string input;
+    const char alphabet[] = {' ', '\t', '\n', '\v', '\f', '\r', '-', 'a', 'z', '\x08', '\x0e', '\x80'};
+    unsigned seed = 12345;
+    for (int i = 0; i < 1000; i++) {
+        seed = seed * 1103515245u + 12345u;
+        input += alphabet[(seed >> 16) % sizeof(alphabet)];
+    }
+    std::vector<detail::ScanFunction> scanners = {detail::ScanScalar, detail::GetScanFunction()};
+#ifdef EASYCLI_SIMD_X86
+    scanners.push_back(detail::ScanSse2);
+    if (__builtin_cpu_supports("avx2")) {
+        scanners.push_back(detail::ScanAvx2);
+    }
+#endif
+    for (std::size_t pos = 0; pos <= input.size(); pos++) {
+        for (bool want_space : {true, false}) {
+            const std::size_t expected = detail::ScanScalar(input.data(), pos, input.size(), want_space);
+            for (detail::ScanFunction scan : scanners) {
+                EXPECT_EQ(scan(input.data(), pos, input.size(), want_space), expected);
+            }
+        }
+    }
+}
+
+TEST(EasyCliTest, ExecuteArgvTest) {
+    EasyCLI cli;
+    cli.RegisterCommand("echo", echo);
+    cli.RegisterCommand("flag", flag);
+    char program[] = "app", command[] = "echo", spaced[] = "Hello   World", empty[] = "", dash[] = "-x";
+    char *argv[] = {program, command, spaced, empty, dash, nullptr};
+
+    CommandArgumentsView view;
+    ParseArgv(5, argv, view);
+    EXPECT_EQ(view.command, "echo");
+    ASSERT_EQ(view.arguments.size(), 2u);
+    EXPECT_EQ(view.arguments[0].data(), spaced);
+    EXPECT_EQ(view.arguments[1], "");
+    ASSERT_EQ(view.flags.size(), 1u);
+    EXPECT_EQ(view.flags[0], "x");
+
+    char *argv_spaced[] = {program, command, spaced, nullptr};
+    CommandOutput out = cli.ExecuteArgv(3, argv_spaced);
+    EXPECT_EQ(out.out, "Hello   World");
+    EXPECT_TRUE(out.success);
+
+    char unknown[] = "nope";
+    char *argv_unknown[] = {program, unknown, nullptr};
+    out = cli.ExecuteArgv(2, argv_unknown);
+    EXPECT_FALSE(out.success);
+}
+
+TEST(EasyCliTest, StreamErrorTest) {
+    EasyCLI cli;
+    cli.RegisterCommand("multiply", multiply);
+    std::ostringstream out_stream, err_stream;
+
+    CommandOutput out = cli.ExecuteWithErrStream("multiply 2 3", err_stream);
+    EXPECT_TRUE(out.success);
+    cli.ExecuteVoidWithErrStream("multiply 2 3", err_stream);
+    EXPECT_EQ(err_stream.str(), "");
+
+    out = cli.ExecuteIntoStream("multiply x 3", out_stream, err_stream);
+    EXPECT_FALSE(out.success);
+    EXPECT_EQ(err_stream.str(), out.out + "\n");
+    EXPECT_EQ(out_stream.str(), "");
+
+    err_stream.str("");
+    out = cli.ExecuteWithErrStream("divide 6 3", err_stream);
+    EXPECT_EQ(out.out, "Unknown command: \"divide\"");
+    EXPECT_EQ(err_stream.str(), out.out);
+    EXPECT_TRUE(cli.GetCommandsString().size() == 1);
+}
+
+TEST(EasyCliTest, StaticEasyCliTest) {
+    static constexpr auto cli = MakeStaticEasyCLI({StaticCommand{"multiply", multiply}, StaticCommand{"echo", echo}, StaticCommand{"greet", greet}});
+    static_assert(cli.Find("multiply") != nullptr, "multiply is registered");
+    static_assert(cli.Find("divide") == nullptr, "divide isn't registered");
+    static_assert(cli.Find("echo")->name == "echo", "lookup returns the right command");
+
+    CommandOutput out = cli.Execute("multiply 2 3");
+    EXPECT_EQ(out.out, "6");
+    EXPECT_TRUE(out.success);
+    out = cli.Execute("greet World");
+    EXPECT_EQ(out.out, "Hello, World!");
+    out = cli.Execute("divide 6 3");
+    EXPECT_FALSE(out.success);
+    EXPECT_EQ(cli.GetCommands().size(), 3u);
+
+    EXPECT_THROW(StaticEasyCLI<2>({StaticCommand{"echo", echo}, StaticCommand{"echo", greet}}), std::invalid_argument);
+}
+
+TEST(EasyCliTest, CommandFunctionTest) {
+    CommandFunction empty;
+    EXPECT_FALSE(empty);
+    EXPECT_THROW(empty(CommandArguments{}), std::bad_function_call);
+
+    CommandFunction pointer = greet;
+    EXPECT_NE(pointer.target<CommandOutput (*)(const CommandArguments &)>(), nullptr);
+
+    std::string prefix = "small:";
+    CommandFunction small = [prefix](const CommandArguments &args) { return CommandOutput{prefix + args.command, true}; };
+    std::array<std::string, 4> big_capture = {"big:", "", "", ""};
+    CommandFunction big = [big_capture](const CommandArguments &args) { return CommandOutput{big_capture[0] + args.command, true}; };
+
+    CommandFunction small_copy = small;
+    CommandFunction big_copy = big;
+    CommandFunction big_moved = std::move(big);
+    EXPECT_FALSE(big);
+    small = big_moved;
+
+    CommandArguments args;
+    args.command = "cmd";
+    EXPECT_EQ(small_copy(args).out, "small:cmd");
+    EXPECT_EQ(big_copy(args).out, "big:cmd");
+    EXPECT_EQ(big_moved(args).out, "big:cmd");
+    EXPECT_EQ(small(args).out, "big:cmd");
+    EXPECT_EQ(pointer(ParseArgs("greet World")).out, "Hello, World!");
+
+    EasyCLI cli;
+    cli.RegisterCommand("small", small_copy);
+    cli.RegisterCommand("std", std::function<CommandOutput(const CommandArguments &)>(multiply));
+    EXPECT_EQ(cli.Execute("small").out, "small:small");
+    EXPECT_EQ(cli.Execute("std 4 5").out, "20");
+    cli.RegisterCommand("lambda", [prefix](const CommandArguments &) { return CommandOutput{prefix, true}; });
+    EXPECT_EQ(cli.Execute("lambda").out, "small:");
+}
+
+// Runs until it is told to stop, checking every millisecond
+COMMAND_FUNCTION(spin) {
+    while (!args.stop_requested()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return CommandOutput{"stopped", true};
+}
+
+STREAMING_COMMAND_FUNCTION(count) {
+    try {
+        const int n = std::stoi(args.arguments.at(0));
+        for (int i = 1; i <= n; i++) {
+            out.Write(std::to_string(i));
+            out.Write(i < n ? "," : "");
+        }
+        return CommandOutput{"", true};
+    } catch (std::exception &e) {
+        return CommandOutput{e.what(), false};
+    }
+}
+
+TEST(EasyCliTest, StreamingCommandTest) {
+    EasyCLI cli;
+    cli.RegisterCommand("count", count);
+    cli.RegisterCommand("multiply", multiply);
+
+    // The streamed output is collected when no sink is given
+    CommandOutput out = cli.Execute("count 3");
+    EXPECT_EQ(out.out, "1,2,3");
+    EXPECT_TRUE(out.success);
+
+    StringOutputSink sink;
+    std::ostringstream err_stream;
+    out = cli.ExecuteIntoSink("count 4", sink, err_stream);
+    EXPECT_TRUE(out.success);
+    out = cli.ExecuteIntoSink("multiply 2 3", sink, err_stream);
+    EXPECT_EQ(out.out, "6");
+    out = cli.ExecuteIntoSink("count x", sink, err_stream);
+    EXPECT_FALSE(out.success);
+    EXPECT_EQ(sink.out, "1,2,3,4\n6\n");
+    EXPECT_EQ(err_stream.str(), out.out + "\n");
+
+    std::ostringstream out_stream;
+    cli.ExecuteVoidIntoStream("count 2", out_stream, err_stream);
+    cli.ExecuteIntoStream("multiply 3 3", out_stream, err_stream);
+    EXPECT_EQ(out_stream.str(), "1,2\n9\n");
+}
+
+#ifdef EASYCLI_POSIX
+TEST(EasyCliTest, ServerTest) {
+    EasyCLI cli;
+    cli.RegisterCommand("count", count);
+    cli.RegisterCommand("echo", echo);
+    cli.RegisterCommand("spin", spin);
+    const std::string socket_path = "/tmp/easycli_test_" + std::to_string(::getpid()) + ".sock";
+    EasyCLIServer server(cli, socket_path);
+    server.SetCommandTimeout(std::chrono::milliseconds(20));
+    server.SetRequestTimeout(std::chrono::milliseconds(50));
+    bool served = false;
+    std::thread thread([&] { served = server.Serve(); });
+
+    char program[] = "app", command[] = "echo", spaced[] = "Hello   World", count_command[] = "count", bad[] = "x";
+    char *argv[] = {program, command, spaced, nullptr};
+    std::ostringstream out_stream, err_stream;
+    int status = -1;
+    // The server thread may not be listening yet
+    for (int attempt = 0; attempt < 500 && status < 0; attempt++) {
+        status = ForwardToServer(socket_path, 3, argv, out_stream, err_stream);
+        if (status < 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+    }
+    EXPECT_EQ(status, 0);
+    EXPECT_EQ(out_stream.str(), "Hello   World\n");
+
+    // A client that stalls halfway through its request is dropped, and doesn't hold up the next one
+    sockaddr_un address;
+    ASSERT_TRUE(detail::MakeSocketAddress(socket_path, address));
+    const int stalled = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    ASSERT_EQ(::connect(stalled, reinterpret_cast<sockaddr *>(&address), sizeof(address)), 0);
+    const char partial[2] = {1, 0};
+    ASSERT_EQ(::send(stalled, partial, sizeof(partial), 0), 2);
+    out_stream.str("");
+    EXPECT_EQ(ForwardToServer(socket_path, 3, argv, out_stream, err_stream), 0);
+    EXPECT_EQ(out_stream.str(), "Hello   World\n");
+    ::close(stalled);
+
+    // A client that sends a request with a lot of output but never reads it is dropped after one send timeout
+    std::string request;
+    for (const std::string &arg : {std::string("app"), std::string("count"), std::string("2000000")}) {
+        const std::uint32_t length = static_cast<std::uint32_t>(arg.size());
+        if (request.empty()) {
+            const std::uint32_t argc = 3;
+            request.append(reinterpret_cast<const char *>(&argc), sizeof(argc));
+        }
+        request.append(reinterpret_cast<const char *>(&length), sizeof(length));
+        request += arg;
+    }
+    const int deaf = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    ASSERT_EQ(::connect(deaf, reinterpret_cast<sockaddr *>(&address), sizeof(address)), 0);
+    ASSERT_TRUE(detail::SendAll(deaf, request.data(), request.size()));
+    const auto start = std::chrono::steady_clock::now();
+    out_stream.str("");
+    EXPECT_EQ(ForwardToServer(socket_path, 3, argv, out_stream, err_stream), 0);
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(2));
+    EXPECT_EQ(out_stream.str(), "Hello   World\n");
+    ::close(deaf);
+
+    // The socket of a live server is not taken over
+    EasyCLIServer second(cli, socket_path);
+    EXPECT_FALSE(second.Serve());
+
+    char *argv_bad[] = {program, count_command, bad, nullptr};
+    EXPECT_EQ(ForwardToServer(socket_path, 3, argv_bad, out_stream, err_stream), 1);
+    EXPECT_FALSE(err_stream.str().empty());
+
+    char spin_command[] = "spin";
+    char *argv_spin[] = {program, spin_command, nullptr};
+    std::ostringstream spin_err;
+    EXPECT_EQ(ForwardToServer(socket_path, 2, argv_spin, out_stream, spin_err), 1);
+    EXPECT_NE(spin_err.str().find("timed out"), std::string::npos);
+
+    server.Stop();
+    thread.join();
+    EXPECT_TRUE(served);
+    EXPECT_EQ(ForwardToServer(socket_path, 3, argv, out_stream, err_stream), -1);
+
+    // Nor is a file that isn't a socket
+    const std::string file_path = socket_path + ".txt";
+    std::ofstream(file_path) << "keep";
+    EasyCLIServer over_file(cli, file_path);
+    EXPECT_FALSE(over_file.Serve());
+    std::ifstream kept(file_path);
+    EXPECT_EQ(std::string(std::istreambuf_iterator<char>(kept), {}), "keep");
+    std::remove(file_path.c_str());
+}
+#endif
+
+TEST(EasyCliTest, ConcurrentAccessTest) {
+    EasyCLI cli;
+    cli.RegisterCommand("multiply", multiply);
+    cli.EnableConcurrentAccess();
+
+    std::atomic<bool> done{false};
+    std::atomic<int> failures{0};
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 4; i++) {
+        readers.emplace_back([&] {
+            while (!done) {
+                if (cli.Execute("multiply 2 3").out != "6") {
+                    failures++;
+                }
+                cli.Execute("cmd_10 x");
+            }
+        });
+    }
+    for (int i = 0; i < 200; i++) {
+        cli.RegisterCommand("cmd_" + std::to_string(i), echo);
+    }
+    done = true;
+    for (std::thread &reader : readers) {
+        reader.join();
+    }
+    EXPECT_EQ(failures, 0);
+    EXPECT_EQ(cli.GetCommandsString().size(), 201u);
+    EXPECT_EQ(cli.Execute("cmd_199 a b").out, "a b");
+
+    EasyCLI copy = cli;
+    copy.RegisterCommand("greet", greet);
+    EXPECT_EQ(copy.Execute("greet World").out, "Hello, World!");
+    EXPECT_FALSE(cli.Execute("greet World").success);
+}
+
+TEST(EasyCliTest, SnapshotReclaimTest) {
+    CommandMap commands;
+    commands.emplace("echo", echo);
+    detail::SnapshotRegistry registry(commands);
+
+    // Each new guard is taken before the last one is released, so the reader's slot is never at 0
+    std::atomic<bool> done{false};
+    std::thread reader([&] {
+        auto guard = std::make_unique<detail::RegistryReadGuard>(registry);
+        while (!done) {
+            auto next = std::make_unique<detail::RegistryReadGuard>(registry);
+            EXPECT_NE(next->Find("echo"), nullptr);
+            guard = std::move(next);
+            std::this_thread::yield();
+        }
+    });
+    std::size_t most_retired = 0;
+    for (int i = 0; i < 200; i++) {
+        commands.emplace("cmd_" + std::to_string(i), echo);
+        {
+            std::lock_guard<std::mutex> lock(registry.writer);
+            registry.Publish(commands);
+            most_retired = std::max(most_retired, registry.RetiredCount());
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+    done = true;
+    reader.join();
+    EXPECT_LE(most_retired, 10u);
+
+    std::lock_guard<std::mutex> lock(registry.writer);
+    registry.Publish(commands);
+    EXPECT_EQ(registry.RetiredCount(), 0u);
+}
+
+TEST(EasyCliTest, ExecuteBatchTest) {
+    EasyCLI cli;
+    cli.RegisterCommand("multiply", multiply);
+    std::vector<std::string> lines;
+    for (int i = 0; i < 1000; i++) {
+        lines.push_back(i % 100 == 99 ? "divide " + std::to_string(i) : "multiply " + std::to_string(i) + " 2");
+    }
+    WorkStealingPool pool(3);
+    EXPECT_EQ(pool.Size(), 3u);
+
+    std::vector<CommandOutput> outputs = cli.ExecuteBatch(lines, pool, 16);
+    ASSERT_EQ(outputs.size(), lines.size());
+    for (int i = 0; i < 1000; i++) {
+        if (i % 100 == 99) {
+            EXPECT_FALSE(outputs[i].success);
+        } else {
+            EXPECT_EQ(outputs[i].out, std::to_string(i * 2));
+        }
+    }
+
+    // Batches submitted from inside a pool task must not deadlock the pool
+    std::atomic<std::size_t> completed{0};
+    for (int t = 0; t < 4; t++) {
+        pool.Submit([&] { cli.ExecuteBatch(lines.data(), lines.size(), pool, [&](std::size_t, CommandOutput &&) { completed++; }, 7); });
+    }
+    while (completed < 4 * lines.size()) {
+        std::this_thread::yield();
+    }
+    EXPECT_EQ(completed, 4 * lines.size());
+    EXPECT_TRUE(cli.ExecuteBatch(lines.data(), 0, pool).empty());
+
+    // A throwing command fails the batch on the calling thread, after every chunk has stopped
+    cli.RegisterCommand("num", [](const CommandArguments &args) { return CommandOutput{std::to_string(std::stoi(args.arguments.at(0))), true}; });
+    std::vector<std::string> throwing(500, "num 1");
+    throwing[321] = "num x";
+    for (int run = 0; run < 20; run++) {
+        EXPECT_THROW(cli.ExecuteBatch(throwing, pool, 8), std::invalid_argument);
+    }
+    // A task that throws doesn't end its worker
+    pool.Submit([] { throw std::runtime_error("task"); });
+    EXPECT_EQ(cli.ExecuteBatch(lines, pool, 16)[0].out, "0");
+}
+
+TEST(EasyCliTest, InstrumentationTest) {
+    EasyCLI cli;
+    cli.RegisterCommand("multiply", multiply);
+    EXPECT_TRUE(cli.GetStats().empty());
+    cli.EnableInstrumentation();
+    cli.RegisterCommand("count", count);
+
+    for (int i = 0; i < 10; i++) {
+        cli.Execute("multiply 2 3");
+    }
+    cli.Execute("multiply x 3");
+    StringOutputSink sink;
+    std::ostringstream err_stream;
+    cli.ExecuteIntoSink("count 3", sink, err_stream);
+    EXPECT_EQ(sink.out, "1,2,3\n");
+
+    std::vector<CommandStats> stats = cli.GetStats();
+    ASSERT_EQ(stats.size(), 2u);
+    EXPECT_EQ(stats[0].name, "count");
+    EXPECT_EQ(stats[0].calls, 1u);
+    EXPECT_EQ(stats[1].name, "multiply");
+    EXPECT_EQ(stats[1].calls, 11u);
+    EXPECT_EQ(stats[1].successes, 10u);
+    EXPECT_EQ(stats[1].failures, 1u);
+    EXPECT_GT(stats[1].LatencyPercentile(99), 0u);
+    EXPECT_GE(stats[1].LatencyPercentile(99), stats[1].LatencyPercentile(50));
+
+    CommandOutput out = cli.Execute("stats");
+    EXPECT_TRUE(out.success);
+    EXPECT_NE(out.out.find("multiply"), std::string::npos);
+
+    cli.ResetStats();
+    EXPECT_EQ(cli.GetStats()[1].calls, 0u);
+
+    for (std::uint64_t ns : {0ull, 7ull, 8ull, 100ull, 12345ull, 1ull << 30}) {
+        const std::size_t bucket = detail::LatencyBucket(ns);
+        EXPECT_LE(CommandStats::LatencyBucketLowerBound(bucket), ns);
+        EXPECT_GT(CommandStats::LatencyBucketLowerBound(bucket + 1), ns);
+    }
+}
+
+TEST(EasyCliTest, OptionsTest) {
+    const std::string input = "build bits=64 -opt=3 target =x -v bits=32 -empty=";
+    CommandArguments args = ParseArgs(input);
+    EXPECT_EQ(args.arguments, (std::vector<std::string>{"target", "=x"}));
+    EXPECT_EQ(args.flags, (std::vector<std::string>{"opt", "v", "empty"}));
+    ASSERT_EQ(args.options.size(), 3u);
+    EXPECT_EQ(args.options["bits"], "32");
+    EXPECT_EQ(args.options["opt"], "3");
+    EXPECT_TRUE(args.options.contains("empty"));
+    EXPECT_EQ(args.options["empty"], "");
+    EXPECT_FALSE(args.options.contains("v"));
+    EXPECT_EQ(args.options.get("missing", "default"), "default");
+
+    CommandArgumentsView view = ParseArgsView(input);
+    EXPECT_EQ(view.options["bits"].data(), input.data() + input.rfind("32"));
+    CommandArguments copied = view.ToCommandArguments();
+    EXPECT_EQ(copied.options["opt"], "3");
+    EXPECT_EQ(copied.options.size(), 3u);
+
+    // Copies own their keys and values, and the index keeps working as the map grows
+    OptionMap options;
+    for (int i = 0; i < 100; i++) {
+        options.insert("key" + std::to_string(i), std::to_string(i * i));
+    }
+    OptionMap copy = options;
+    options.clear();
+    EXPECT_TRUE(options.empty());
+    ASSERT_EQ(copy.size(), 100u);
+    for (int i = 0; i < 100; i++) {
+        EXPECT_EQ(copy["key" + std::to_string(i)], std::to_string(i * i));
+    }
+}
+
+TEST(EasyCliTest, KnownFlagsTest) {
+    EasyCLI cli;
+    // Flags are numbered in the order they were declared
+    cli.RegisterCommand(
+        "ls",
+        [](const CommandArguments &args) {
+            std::string out;
+            out += args.flags_contains(std::size_t{0}) ? "l" : "-";
+            out += args.flags_contains(std::size_t{1}) ? "a" : "-";
+            out += args.flags_contains("a") ? "a" : "-";
+            out += args.flags_contains("color") ? "c" : "-";
+            out += args.flags_contains(std::size_t{2}) ? "?" : "-";
+            return CommandOutput{out, true};
+        },
+        {"l", "a"});
+    EXPECT_EQ(cli.Execute("ls -a -color").out, "-aac-");
+    EXPECT_EQ(cli.Execute("ls -l").out, "l----");
+
+    // Declared flags survive instrumentation, and work from argv
+    cli.EnableInstrumentation();
+    std::string arg0 = "prog", arg1 = "ls", arg2 = "-l", arg3 = "-a";
+    char *argv[] = {arg0.data(), arg1.data(), arg2.data(), arg3.data()};
+    EXPECT_EQ(cli.ExecuteArgv(4, argv).out, "laa--");
+
+    // Commands without declared flags fall back to searching the flags
+    cli.RegisterCommand("flag", flag);
+    EXPECT_TRUE(cli.Execute("flag -flag").success);
+    EXPECT_EQ(cli.Execute("flag -flag").out, "Flag is set");
+
+    EXPECT_THROW(cli.RegisterCommand("dup", flag, {"x", "x"}), std::invalid_argument);
+}
+
+TEST(EasyCliTest, AllocationFreeExecuteTest) {
+    EasyCLI cli;
+    cli.RegisterCommand("multiply", multiply);
+    cli.RegisterCommand("outer", [&cli](const CommandArguments &args) {
+        // The nested call parses into its own arguments, so args is left alone
+        const CommandOutput inner = cli.Execute("multiply 2 3 argument_longer_than_the_small_string_buffer");
+        return CommandOutput{inner.out + args.arguments[0], true};
+    });
+    EXPECT_EQ(cli.Execute("outer first_argument_longer_than_the_small_string_buffer").out, "6first_argument_longer_than_the_small_string_buffer");
+
+    const std::string long_input = "multiply 6 7 -flag_longer_than_the_small_string_buffer option_key_longer_than_sso=option_value_longer_than_sso";
+    const std::string short_input = "multiply 3 4";
+    EXPECT_EQ(cli.Execute(long_input).out, "42");
+    const std::size_t before = allocation_count.load();
+    for (int i = 0; i < 100; i++) {
+        const CommandOutput out = cli.Execute(i % 2 ? long_input : short_input);
+        ASSERT_TRUE(out.success);
+        cli.ExecuteVoid(short_input);
+    }
+    EXPECT_EQ(allocation_count.load() - before, 0u);
+
+    // Parsing into a struct replaces what it held
+    CommandArguments args;
+    ParseArgs(long_input, args);
+    ParseArgs("echo -x hello", args);
+    EXPECT_EQ(args.command, "echo");
+    EXPECT_EQ(args.arguments, (std::vector<std::string>{"hello"}));
+    EXPECT_EQ(args.flags, (std::vector<std::string>{"x"}));
+    EXPECT_TRUE(args.options.empty());
+}
+
+TEST(EasyCliTest, PreparedCommandTest) {
+    EasyCLI cli;
+    cli.RegisterCommand("multiply", multiply);
+    PreparedCommand prepared = cli.Prepare("multiply 6 7");
+    EXPECT_EQ(prepared.Arguments().arguments, (std::vector<std::string>{"6", "7"}));
+    EXPECT_EQ(prepared.Execute().out, "42");
+    StringOutputSink sink;
+    EXPECT_TRUE(prepared.Execute(sink).success);
+    EXPECT_EQ(sink.out, "42");
+
+    // Re-registering the command is picked up by the next call
+    cli.RegisterCommand("multiply", [](const CommandArguments &args) { return CommandOutput{args.arguments[0] + "*" + args.arguments[1], true}; });
+    EXPECT_EQ(prepared.Execute().out, "6*7");
+
+    // An unknown command runs once it is registered, with its declared flags
+    PreparedCommand later = cli.Prepare("later -v");
+    EXPECT_FALSE(later.Execute().success);
+    cli.RegisterCommand("later", [](const CommandArguments &args) { return CommandOutput{args.flags_contains(std::size_t{0}) ? "verbose" : "quiet", true}; }, {"v"});
+    EXPECT_EQ(later.Execute().out, "verbose");
+
+    // Handles survive instrumentation and count as calls
+    cli.EnableInstrumentation();
+    EXPECT_EQ(prepared.Execute().out, "6*7");
+    EXPECT_EQ(cli.GetStats()[1].name, "multiply");
+    EXPECT_EQ(cli.GetStats()[1].calls, 1u);
+}
+
+TEST(EasyCliTest, BufferedOutputTest) {
+    EasyCLI cli;
+    cli.RegisterCommand("multiply", multiply);
+    StringOutputSink target;
+    {
+        BufferedOutputSink buffered(target, 8, std::chrono::hours(1));
+        cli.ExecuteIntoSink("multiply 6 7", buffered);
+        EXPECT_EQ(target.out, "");
+        cli.ExecuteIntoSink("multiply 2 3", buffered);
+        cli.ExecuteIntoSink("multiply 5 5", buffered);
+        // Full buffers are passed on
+        EXPECT_EQ(target.out, "42\n6\n25\n");
+        buffered.Write("1");
+        EXPECT_EQ(target.out, "42\n6\n25\n");
+        buffered.Flush();
+        EXPECT_EQ(target.out, "42\n6\n25\n1");
+        // Writes bigger than the buffer go straight through
+        buffered.Write("0123456789");
+        EXPECT_EQ(target.out, "42\n6\n25\n10123456789");
+        buffered.Write("x");
+    }
+    // Destruction flushes
+    EXPECT_EQ(target.out, "42\n6\n25\n10123456789x");
+
+    // Output older than max_delay is passed on at the next write
+    target.out.clear();
+    BufferedOutputSink delayed(target, 1024, std::chrono::milliseconds(0));
+    delayed.Write("now");
+    EXPECT_EQ(target.out, "now");
+
+#ifdef EASYCLI_POSIX
+    int fds[2];
+    ASSERT_EQ(::pipe(fds), 0);
+    {
+        BufferedOutputSink buffered(fds[1], 4);
+        buffered.Write("ab");
+        buffered.Write("cdefgh");
+        buffered.Write("i");
+    }
+    ::close(fds[1]);
+    char read_buffer[16];
+    std::string piped;
+    ssize_t got;
+    while ((got = ::read(fds[0], read_buffer, sizeof(read_buffer))) > 0) {
+        piped.append(read_buffer, static_cast<std::size_t>(got));
+    }
+    ::close(fds[0]);
+    EXPECT_EQ(piped, "abcdefghi");
+#endif
+}
+
+TEST(EasyCliTest, RunStreamTest) {
+    EasyCLI cli;
+    cli.RegisterCommand("multiply", multiply);
+    cli.RegisterCommand("echo", echo);
+
+    // A line longer than the read buffer, blank lines, CRLF line endings and no final newline
+    const std::string long_argument(100000, 'x');
+    std::istringstream input("multiply 6 7\n\n   \nmultiply 2 3\r\nnope\necho " + long_argument + "\nmultiply 5 5");
+    std::ostringstream output, errors;
+    EXPECT_EQ(cli.RunStream(input, output, errors), 1u);
+    EXPECT_EQ(output.str(), "42\n6\n" + long_argument + "\n25\n");
+    EXPECT_EQ(errors.str(), "Unknown command: \"nope\"\n");
+
+#ifdef EASYCLI_POSIX
+    int in_fds[2], out_fds[2];
+    ASSERT_EQ(::pipe(in_fds), 0);
+    ASSERT_EQ(::pipe(out_fds), 0);
+    const std::string script = "multiply 6 7\nmultiply 3 3\n";
+    ASSERT_EQ(::write(in_fds[1], script.data(), script.size()), static_cast<ssize_t>(script.size()));
+    ::close(in_fds[1]);
+    EXPECT_EQ(cli.RunStream(in_fds[0], out_fds[1], out_fds[1]), 0u);
+    ::close(in_fds[0]);
+    ::close(out_fds[1]);
+    char read_buffer[64];
+    const ssize_t got = ::read(out_fds[0], read_buffer, sizeof(read_buffer));
+    ::close(out_fds[0]);
+    ASSERT_GT(got, 0);
+    EXPECT_EQ(std::string(read_buffer, static_cast<std::size_t>(got)), "42\n9\n");
+#endif
+}
+
+TEST(EasyCliTest, ExecuteFileTest) {
+    EasyCLI cli;
+    cli.RegisterCommand("multiply", multiply);
+    const std::string path = "easycli_test_script.txt";
+    std::string script, expected;
+    for (int i = 0; i < 1000; i++) {
+        script += "multiply " + std::to_string(i) + " 2\n";
+        expected += std::to_string(i * 2) + "\n";
+    }
+    script += "nope\nmultiply 1 1";
+    expected += "1\n";
+    std::ofstream(path, std::ios::binary) << script;
+
+    std::ostringstream output, errors;
+    EXPECT_EQ(cli.ExecuteFile(path, output, errors), 1u);
+    EXPECT_EQ(output.str(), expected);
+    EXPECT_EQ(errors.str(), "Unknown command: \"nope\"\n");
+
+    // Small chunks, so the output of many chunks has to be put back in order
+    WorkStealingPool pool(3);
+    std::ostringstream parallel_output, parallel_errors;
+    EXPECT_EQ(cli.ExecuteFile(path, pool, parallel_output, parallel_errors, 64), 1u);
+    EXPECT_EQ(parallel_output.str(), expected);
+    EXPECT_EQ(parallel_errors.str(), "Unknown command: \"nope\"\n");
+
+    // A throwing command fails the whole file on the calling thread, once the chunks still running have stopped
+    cli.RegisterCommand("num", [](const CommandArguments &args) { return CommandOutput{std::to_string(std::stoi(args.arguments.at(0))), true}; });
+    std::string throwing;
+    for (int i = 0; i < 1000; i++) {
+        throwing += i == 700 ? "num x\n" : "num 1\n";
+    }
+    std::ofstream(path, std::ios::binary) << throwing;
+    for (int run = 0; run < 20; run++) {
+        std::ostringstream ignored;
+        EXPECT_THROW(cli.ExecuteFile(path, pool, ignored, ignored, 64), std::invalid_argument);
+    }
+
+    std::remove(path.c_str());
+    EXPECT_THROW(cli.ExecuteFile(path, output, errors), std::runtime_error);
+}
+
+TEST(EasyCliTest, CommandIndexTest) {
+    EasyCLI cli;
+    for (const char *name : {"status", "stash", "start", "multiply", "st", "echo"}) {
+        cli.RegisterCommand(name, multiply);
+    }
+    cli.RegisterCommand("stash", echo);
+    EXPECT_EQ(cli.GetCommandsString(), (std::vector<std::string>{"echo", "multiply", "st", "start", "stash", "status"}));
+    EXPECT_EQ(cli.Complete("sta"), (std::vector<std::string>{"start", "stash", "status"}));
+    EXPECT_EQ(cli.Complete("stas"), (std::vector<std::string>{"stash"}));
+    EXPECT_EQ(cli.Complete("st"), (std::vector<std::string>{"st", "start", "stash", "status"}));
+    EXPECT_TRUE(cli.Complete("stx").empty());
+    EXPECT_TRUE(cli.Complete("statusbar").empty());
+    EXPECT_GT(cli.GetIndexMemoryUsage(), 0u);
+
+    // Abbreviations are off by default, then any unique prefix works and exact names win
+    EXPECT_FALSE(cli.Execute("mul 6 7").success);
+    cli.EnableAbbreviations();
+    EXPECT_EQ(cli.Execute("mul 6 7").out, "42");
+    EXPECT_EQ(cli.Execute("stas a b").out, "a b");
+    EXPECT_EQ(cli.Execute("st 2 3").out, "6");
+    EXPECT_FALSE(cli.Execute("sta 2 3").success);
+    EXPECT_FALSE(cli.Execute("x").success);
+
+    // Copies get their own index
+    EasyCLI copy = cli;
+    copy.RegisterCommand("multiplex", echo);
+    EXPECT_FALSE(copy.Execute("mul 6 7").success);
+    EXPECT_EQ(cli.Execute("mul 6 7").out, "42");
+    EXPECT_EQ(copy.Complete("multi").size(), 2u);
+}
+
+// Exposes the lock of the name index, to check which paths take it
+class IndexLockingCLI : public EasyCLI {
+  public:
+    std::mutex &IndexMutex() {
+        return index->mutex;
+    }
+};
+
+TEST(EasyCliTest, ConcurrentAbbreviationsTest) {
+    IndexLockingCLI cli;
+    cli.RegisterCommand("multiply", multiply);
+    cli.EnableConcurrentAccess();
+    cli.EnableAbbreviations();
+    EXPECT_EQ(cli.Execute("mul 6 7").out, "42");
+    cli.RegisterCommand("status", echo);
+    EXPECT_EQ(cli.Execute("stat a").out, "a");
+    cli.RegisterCommand("stash", echo);
+    EXPECT_FALSE(cli.Execute("sta a").success);
+
+    // Abbreviations resolve from the published snapshot, even while a writer holds the index
+    std::unique_lock<std::mutex> held(cli.IndexMutex());
+    std::atomic<bool> resolved{false};
+    std::thread reader([&] { resolved = cli.Execute("mul 2 3").out == "6"; });
+    const auto give_up = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (!resolved && std::chrono::steady_clock::now() < give_up) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    held.unlock();
+    reader.join();
+    EXPECT_TRUE(resolved);
+
+    EasyCLI copy = cli;
+    EXPECT_EQ(copy.Execute("mul 3 3").out, "9");
+}
+
+TEST(EasyCliTest, SuggestionsTest) {
+    // The bit-parallel distance matches the classic algorithm, which long patterns use
+    const std::string alphabet = "abc";
+    std::uint32_t seed = 1;
+    const auto random_word = [&](std::size_t max_length) {
+        std::string word;
+        seed = seed * 1103515245 + 12345;
+        const std::size_t length = (seed >> 16) % (max_length + 1);
+        for (std::size_t i = 0; i < length; i++) {
+            seed = seed * 1103515245 + 12345;
+            word += alphabet[(seed >> 16) % alphabet.size()];
+        }
+        return word;
+    };
+    for (int i = 0; i < 500; i++) {
+        const std::string a = random_word(12), b = random_word(12);
+        const std::string long_a = a + std::string(64, 'z'), long_b = b + std::string(64, 'z');
+        EXPECT_EQ(detail::EditDistance(a).To(b), detail::EditDistance(long_a).To(long_b)) << a << " " << b;
+    }
+    EXPECT_EQ(detail::EditDistance("kitten").To("sitting"), 3u);
+    EXPECT_EQ(detail::EditDistance("").To("abc"), 3u);
+
+    EasyCLI cli;
+    for (const char *name : {"status", "stash", "start", "multiply", "echo", "commit", "checkout"}) {
+        cli.RegisterCommand(name, multiply);
+    }
+    EXPECT_EQ(cli.Suggest("stats"), (std::vector<std::string>{"status", "start", "stash"}));
+    EXPECT_EQ(cli.Suggest("stats", 1), (std::vector<std::string>{"status"}));
+    EXPECT_EQ(cli.Suggest("comit", 3, 1), (std::vector<std::string>{"commit"}));
+    EXPECT_TRUE(cli.Suggest("zzzzzzz").empty());
+
+    EXPECT_EQ(cli.Execute("stauts").out, "Unknown command: \"stauts\"");
+    cli.EnableSuggestions();
+    EXPECT_EQ(cli.Execute("stauts").out, "Unknown command: \"stauts\". Did you mean \"start\" or \"status\"?");
+    EXPECT_EQ(cli.Execute("chekout").out, "Unknown command: \"chekout\". Did you mean \"checkout\"?");
+    EXPECT_EQ(cli.Execute("stats").out, "Unknown command: \"stats\". Did you mean \"status\", \"start\" or \"stash\"?");
+    EXPECT_EQ(cli.Execute("zzzzzzz").out, "Unknown command: \"zzzzzzz\"");
+}
+
+TEST(EasyCliTest, GroupsTest) {
+    EasyCLI cli;
+    cli.RegisterCommand("multiply", multiply);
+    EasyCLI &node = cli.RegisterGroup("cluster").RegisterGroup("node");
+    EXPECT_EQ(&cli.RegisterGroup("cluster").RegisterGroup("node"), &node);
+    node.RegisterCommand("drain", [](const CommandArguments &args) {
+        std::string out = args.command;
+        for (const std::string &argument : args.arguments) {
+            out += ' ' + argument;
+        }
+        return CommandOutput{out + (args.flags_contains(0) ? " forced" : ""), true};
+    }, {"force"});
+    node.RegisterCommand("list", [](const CommandArguments &) { return CommandOutput{"n1 n2", true}; });
+
+    // The leaf only sees the tokens after its name
+    EXPECT_EQ(cli.Execute("cluster node drain n1 n2 -force").out, "drain n1 n2 forced");
+    EXPECT_EQ(cli.Execute("multiply 6 7").out, "42");
+    EXPECT_EQ(cli.GetCommandsString(), (std::vector<std::string>{"cluster", "multiply"}));
+
+    // Errors name the whole path
+    EXPECT_EQ(cli.Execute("cluster node dran n1").out, "Unknown command: \"cluster node dran\"");
+    EXPECT_EQ(cli.Execute("cluster node").out, "Missing subcommand after \"cluster node\". Available subcommands: drain, list");
+    EXPECT_FALSE(cli.Execute("cluster").success);
+
+    // Settings reach the groups, and lookups in a group use them
+    cli.EnableAbbreviations();
+    cli.EnableSuggestions();
+    EXPECT_EQ(cli.Execute("cl no li").out, "n1 n2");
+    EXPECT_EQ(cli.Execute("cluster node lsit").out, "Unknown command: \"cluster node lsit\". Did you mean \"list\"?");
+
+    // Every way of executing walks the groups
+    char arg0[] = "app", arg1[] = "cluster", arg2[] = "node", arg3[] = "drain", arg4[] = "two words";
+    char *argv[] = {arg0, arg1, arg2, arg3, arg4};
+    EXPECT_EQ(cli.ExecuteArgv(5, argv).out, "drain two words");
+    PreparedCommand prepared = cli.Prepare("cluster node list");
+    EXPECT_EQ(prepared.Execute().out, "n1 n2");
+    std::istringstream script("cluster node list\ncluster node drain n3\n");
+    std::ostringstream output, errors;
+    EXPECT_EQ(cli.RunStream(script, output, errors), 0u);
+    EXPECT_EQ(output.str(), "n1 n2\ndrain n3\n");
+
+    // A group called with arguments parsed for it runs the subcommand they name
+    const CommandArguments args = ParseArgs("cluster node drain n4");
+    for (const CommandFunction &fn : cli.GetCommands()) {
+        if (fn.target<CommandOutput (*)(const CommandArguments &)>() == nullptr) {
+            EXPECT_EQ(fn(args).out, "drain n4");
+        }
+    }
+
+    // A plain command isn't silently replaced by a group
+    EXPECT_THROW(cli.RegisterGroup("multiply"), std::invalid_argument);
+    EXPECT_EQ(cli.Execute("multiply 2 3").out, "6");
+
+    // Concurrent registrations of one group all get the same group
+    EasyCLI shared;
+    shared.EnableConcurrentAccess();
+    std::vector<EasyCLI *> groups(8);
+    std::vector<std::thread> registrars;
+    for (std::size_t i = 0; i < groups.size(); i++) {
+        registrars.emplace_back([&shared, &groups, i] {
+            groups[i] = &shared.RegisterGroup("jobs");
+            groups[i]->RegisterCommand("echo_" + std::to_string(i), echo);
+        });
+    }
+    for (std::thread &registrar : registrars) {
+        registrar.join();
+    }
+    for (EasyCLI *group : groups) {
+        EXPECT_EQ(group, groups[0]);
+    }
+    EXPECT_EQ(shared.Complete("jobs").size(), 1u);
+    EXPECT_EQ(shared.Execute("jobs echo_7 x").out, "x");
+
+    // Walking the groups doesn't allocate once warmed up
+    const std::string input = "cluster node drain n1 -force";
+    EXPECT_TRUE(cli.Execute(input).success);
+    const std::size_t before = allocation_count.load();
+    for (int i = 0; i < 100; i++) {
+        ASSERT_TRUE(cli.Execute(input).success);
+    }
+    EXPECT_EQ(allocation_count.load() - before, 0u);
+}
+
+#ifdef EASYCLI_COROUTINES
+static CommandTask slow_echo(const CommandArguments &args) {
+    co_await SleepFor(std::chrono::milliseconds(20));
+    co_return CommandOutput{args.arguments.empty() ? "" : args.arguments[0], true};
+}
+
+TEST(EasyCliTest, CoroutineCommandTest) {
+    EasyCLI cli;
+    cli.RegisterCommand("multiply", multiply);
+    cli.RegisterCommand("slow_echo", slow_echo);
+    // Outside of a loop, the command runs to completion on a loop of its own
+    EXPECT_EQ(cli.Execute("slow_echo hello").out, "hello");
+
+    // A thousand sleeping commands are in flight at once on this thread, so this takes about 20ms instead of 20s
+    EventLoop loop;
+    std::vector<std::string> outputs(1000);
+    for (std::size_t i = 0; i < outputs.size(); i++) {
+        cli.ExecuteAsync("slow_echo " + std::to_string(i), loop, [&outputs, i](CommandOutput &&out) { outputs[i] = std::move(out.out); });
+    }
+    std::string multiply_output, unknown_output;
+    cli.ExecuteAsync("multiply 6 7", loop, [&multiply_output](CommandOutput &&out) { multiply_output = out.out; });
+    cli.ExecuteAsync("divide 6 7", loop, [&unknown_output](CommandOutput &&out) { unknown_output = out.out; });
+    const auto start = std::chrono::steady_clock::now();
+    loop.Run();
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(5));
+    for (std::size_t i = 0; i < outputs.size(); i++) {
+        ASSERT_EQ(outputs[i], std::to_string(i));
+    }
+    EXPECT_EQ(multiply_output, "42");
+    EXPECT_EQ(unknown_output, "Unknown command: \"divide\"");
+
+    // Instrumented coroutine commands count the time they spent suspended
+    cli.EnableInstrumentation();
+    cli.ExecuteAsync("slow_echo x", loop, nullptr);
+    loop.Run();
+    for (const CommandStats &stats : cli.GetStats()) {
+        if (stats.name == "slow_echo") {
+            EXPECT_EQ(stats.calls, 1u);
+            EXPECT_GE(stats.LatencyPercentile(0.5), 15000000u);
+        }
+    }
+
+    // Exceptions reach the caller
+    cli.RegisterCommand("fail", [](const CommandArguments &) -> CommandTask {
+        co_await SleepFor(std::chrono::milliseconds(1));
+        throw std::runtime_error("failed");
+    });
+    EXPECT_THROW(cli.Execute("fail"), std::runtime_error);
+    cli.ExecuteAsync("fail", loop, nullptr);
+    EXPECT_THROW(loop.Run(), std::runtime_error);
+
+    // A command executing another one synchronously works whether it runs on the thread's own loop or on another one
+    EXPECT_EQ(cli.Execute("slow_echo again").out, "again");
+    cli.RegisterCommand("nest", [&cli](const CommandArguments &) -> CommandTask { co_return cli.Execute("slow_echo inner"); });
+    EXPECT_EQ(cli.Execute("nest").out, "inner");
+    std::string nested_output;
+    cli.ExecuteAsync("nest", loop, [&nested_output](CommandOutput &&out) { nested_output = out.out; });
+    loop.Run();
+    EXPECT_EQ(nested_output, "inner");
+}
+
+TEST(EasyCliTest, EventLoopThreadsTest) {
+    EasyCLI cli;
+    WorkStealingPool pool(2);
+    cli.RegisterCommand("double", [&pool](const CommandArguments &args) -> CommandTask {
+        const std::string doubled = co_await Offload(pool, [&args] { return args.arguments[0] + args.arguments[0]; });
+        co_return CommandOutput{doubled, true};
+    });
+#ifdef EASYCLI_POSIX
+    int fds[2];
+    ASSERT_EQ(::pipe(fds), 0);
+    cli.RegisterCommand("read_pipe", [fd = fds[0]](const CommandArguments &) -> CommandTask {
+        co_await WaitReadable(fd);
+        char buffer[16];
+        const ssize_t got = ::read(fd, buffer, sizeof(buffer));
+        co_return CommandOutput{std::string(buffer, got > 0 ? static_cast<std::size_t>(got) : 0), true};
+    });
+#endif
+
+    // Two threads share the loop
+    EventLoop loop;
+    std::atomic<int> completed{0};
+    std::vector<std::string> outputs(200);
+    for (std::size_t i = 0; i < outputs.size(); i++) {
+        cli.ExecuteAsync("double " + std::to_string(i), loop, [&outputs, &completed, i](CommandOutput &&out) {
+            outputs[i] = std::move(out.out);
+            completed++;
+        });
+    }
+#ifdef EASYCLI_POSIX
+    std::string pipe_output;
+    cli.ExecuteAsync("read_pipe", loop, [&pipe_output](CommandOutput &&out) { pipe_output = out.out; });
+    std::thread writer([&fds] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        EXPECT_EQ(::write(fds[1], "ready", 5), 5);
+    });
+#endif
+    std::thread helper([&loop] { loop.Run(); });
+    loop.Run();
+    helper.join();
+    EXPECT_EQ(completed.load(), 200);
+    for (std::size_t i = 0; i < outputs.size(); i++) {
+        ASSERT_EQ(outputs[i], std::to_string(i) + std::to_string(i));
+    }
+#ifdef EASYCLI_POSIX
+    writer.join();
+    EXPECT_EQ(pipe_output, "ready");
+    ::close(fds[0]);
+    ::close(fds[1]);
+#endif
+}
+#endif
+
+TEST(EasyCliTest, CancellationTest) {
+    EasyCLI cli;
+    cli.EnableInstrumentation();
+    cli.RegisterCommand("spin", spin);
+    cli.RegisterCommand("multiply", multiply);
+    cli.RegisterCommand("check", [](const CommandArguments &args) {
+        const bool no_deadline = args.deadline == std::chrono::steady_clock::time_point::max();
+        return CommandOutput{no_deadline && !args.stop_requested() ? "free" : "bounded", true};
+    });
+
+    EXPECT_EQ(cli.Execute("check").out, "free");
+    EXPECT_EQ(cli.ExecuteWithTimeout("check", std::chrono::seconds(10)).out, "bounded");
+    EXPECT_EQ(cli.ExecuteWithTimeout("multiply 2 3", std::chrono::seconds(10)).out, "6");
+    EXPECT_EQ(cli.ExecuteWithTimeout("multiply 2 3", std::chrono::nanoseconds::max()).out, "6");
+    EXPECT_FALSE(cli.ExecuteWithTimeout("missing", std::chrono::seconds(1)).success);
+
+    const auto start = std::chrono::steady_clock::now();
+    CommandOutput out = cli.ExecuteWithTimeout("spin", std::chrono::milliseconds(20));
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(5));
+    EXPECT_FALSE(out.success);
+    EXPECT_EQ(out.out, "Command \"spin\" timed out");
+
+    CancellationToken token = CancellationToken::Create();
+    std::thread canceller([token] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        token.Cancel();
+    });
+    out = cli.ExecuteWithTimeout("spin", std::chrono::nanoseconds::max(), token);
+    canceller.join();
+    EXPECT_TRUE(token.IsCancelled());
+    EXPECT_FALSE(CancellationToken().IsCancelled());
+    EXPECT_EQ(out.out, "Command \"spin\" was cancelled");
+
+    std::vector<CommandStats> stats = cli.GetStats();
+    ASSERT_EQ(stats.size(), 3u);
+    EXPECT_EQ(stats[2].name, "spin");
+    EXPECT_EQ(stats[2].calls, 2u);
+    EXPECT_EQ(stats[2].failures, 2u);
+    EXPECT_EQ(stats[2].timeouts, 1u);
+    EXPECT_EQ(stats[1].timeouts, 0u);
+
+    // With a pool, a command that never checks is abandoned at the deadline
+    std::atomic<bool> released{false};
+    cli.RegisterCommand("stuck", [&released](const CommandArguments &) {
+        while (!released) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return CommandOutput{"late", true};
+    });
+    WorkStealingPool pool(2);
+    out = cli.ExecuteWithTimeout("stuck", std::chrono::milliseconds(20), pool);
+    EXPECT_EQ(out.out, "Command \"stuck\" timed out");
+    released = true;
+    EXPECT_EQ(cli.ExecuteWithTimeout("multiply 4 5", std::chrono::seconds(10), pool).out, "20");
+    EXPECT_EQ(cli.ExecuteWithTimeout("spin", std::chrono::milliseconds(5), pool).out, "Command \"spin\" timed out");
+    EXPECT_FALSE(cli.ExecuteWithTimeout("missing", std::chrono::seconds(1), pool).success);
+
+    // Cancelling the token returns at once, even without a deadline and from a command that never checks
+    released = false;
+    CancellationToken stuck_token = CancellationToken::Create();
+    std::thread stuck_canceller([stuck_token] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        stuck_token.Cancel();
+    });
+    out = cli.ExecuteWithTimeout("stuck", std::chrono::nanoseconds::max(), pool, stuck_token);
+    stuck_canceller.join();
+    EXPECT_EQ(out.out, "Command \"stuck\" was cancelled");
+    released = true;
+
+    // Exceptions reach the caller instead of ending a worker
+    cli.RegisterCommand("num", [](const CommandArguments &args) { return CommandOutput{std::to_string(std::stoi(args.arguments.at(0))), true}; });
+    EXPECT_THROW(cli.ExecuteWithTimeout("num x", std::chrono::seconds(10), pool), std::invalid_argument);
+    EXPECT_THROW(cli.ExecuteWithTimeout("num x", std::chrono::nanoseconds::max(), pool), std::invalid_argument);
+
+    // A command still queued at its deadline never runs
+    WorkStealingPool single(1);
+    std::atomic<int> runs{0};
+    cli.RegisterCommand("counted", [&runs](const CommandArguments &) {
+        runs++;
+        return CommandOutput{"", true};
+    });
+    released = false;
+    EXPECT_FALSE(cli.ExecuteWithTimeout("stuck", std::chrono::milliseconds(5), single).success);
+    EXPECT_EQ(cli.ExecuteWithTimeout("counted", std::chrono::milliseconds(5), single).out, "Command \"counted\" timed out");
+    released = true;
+    // The worker takes its newest task first, so empty the queue before waiting for the worker to be idle
+    while (single.TryRunOne()) {
+    }
+    std::atomic<bool> drained{false};
+    single.Submit([&drained] { drained = true; });
+    while (!drained) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_EQ(runs, 0);
+    stats = cli.GetStats();
+    const auto counted = std::find_if(stats.begin(), stats.end(), [](const CommandStats &command) { return command.name == "counted"; });
+    ASSERT_NE(counted, stats.end());
+    EXPECT_EQ(counted->calls, 1u);
+    EXPECT_EQ(counted->failures, 1u);
+    EXPECT_EQ(counted->timeouts, 1u);
+
+    // Without a deadline, a call from the pool's only worker runs the command itself instead of waiting for a free worker
+    std::atomic<bool> nested_done{false};
+    std::string nested;
+    single.Submit([&] {
+        nested = cli.ExecuteWithTimeout("multiply 6 7", std::chrono::nanoseconds::max(), single).out;
+        nested_done = true;
+    });
+    while (!nested_done) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_EQ(nested, "42");
+}
+
+// Writes the numbers from 1 to n, one per line
+STREAMING_COMMAND_FUNCTION(generate) {
+    const int n = std::stoi(args.arguments.at(0));
+    for (int i = 1; i <= n; i++) {
+        out.Write(std::to_string(i));
+        out.Write("\n");
+    }
+    return CommandOutput{"", true};
+}
+
+// Passes on the lines of its input that contain its argument
+STREAMING_COMMAND_FUNCTION(grep_lines) {
+    if (args.input == nullptr) {
+        return CommandOutput{"grep needs input", false};
+    }
+    LineReader lines(*args.input);
+    std::string_view line;
+    while (lines.Next(line)) {
+        if (line.find(args.arguments.at(0)) != std::string_view::npos) {
+            out.Write(line);
+            out.Write("\n");
+        }
+    }
+    return CommandOutput{"", true};
+}
+
+// Counts the lines of its input
+COMMAND_FUNCTION(count_lines) {
+    std::size_t count = 0;
+    LineReader lines(*args.input);
+    std::string_view line;
+    while (lines.Next(line)) {
+        count++;
+    }
+    return CommandOutput{std::to_string(count), true};
+}
+
+TEST(EasyCliTest, PipelineTest) {
+    std::vector<CommandArguments> parsed = ParsePipeline("generate 10|grep_lines 1 -v | wc x=1");
+    ASSERT_EQ(parsed.size(), 3u);
+    EXPECT_EQ(parsed[0].command, "generate");
+    EXPECT_EQ(parsed[0].arguments, std::vector<std::string>{"10"});
+    EXPECT_EQ(parsed[1].command, "grep_lines");
+    EXPECT_EQ(parsed[1].flags, std::vector<std::string>{"v"});
+    EXPECT_EQ(parsed[2].options["x"], "1");
+    EXPECT_EQ(ParsePipeline("echo a").size(), 1u);
+
+    EasyCLI cli;
+    cli.RegisterCommand("generate", generate);
+    cli.RegisterCommand("grep", grep_lines);
+    cli.RegisterCommand("count", count_lines);
+    cli.RegisterCommand("echo", echo);
+    cli.RegisterGroup("text").RegisterCommand("grep", grep_lines);
+
+    EXPECT_EQ(cli.ExecutePipeline("echo a b").out, "a b");
+    EXPECT_EQ(cli.ExecutePipeline("generate 20 | grep 1").out, "1\n10\n11\n12\n13\n14\n15\n16\n17\n18\n19\n");
+    // Enough output to go through many chunks, and lines split across them
+    EXPECT_EQ(cli.ExecutePipeline("generate 200000 | text grep 7 | grep 3 | count").out, "29340");
+    // A command that doesn't read its input doesn't hold up the ones before it
+    EXPECT_EQ(cli.ExecutePipeline("generate 200000 | echo done").out, "done");
+    EXPECT_EQ(cli.ExecutePipeline("generate 0 | count").out, "0");
+
+    // Exceptions are rethrown once every command has returned
+    EXPECT_THROW(cli.ExecutePipeline("generate 5 | grep"), std::out_of_range);
+    CommandOutput out = cli.ExecutePipeline("generate 5 | missing | count");
+    EXPECT_FALSE(out.success);
+    EXPECT_NE(out.out.find("missing"), std::string::npos);
+    EXPECT_FALSE(cli.ExecutePipeline("generate 5 | ").success);
+    EXPECT_FALSE(cli.ExecutePipeline("grep 1").success);
+
+    // A command that returns its whole output at once still sends it a bounded chunk at a time
+    cli.RegisterCommand("big", [](const CommandArguments &) { return CommandOutput{std::string(1 << 20, 'x'), true}; });
+    cli.RegisterCommand("largest", [](const CommandArguments &args) {
+        std::size_t largest = 0, total = 0;
+        std::string_view chunk;
+        while (args.input->Read(chunk)) {
+            largest = std::max(largest, chunk.size());
+            total += chunk.size();
+        }
+        return CommandOutput{std::to_string(largest) + " " + std::to_string(total), true};
+    });
+    EXPECT_EQ(cli.ExecutePipeline("big | largest").out, std::to_string(detail::kPipeChunkBytes) + " " + std::to_string(1 << 20));
+
+    StringOutputSink sink;
+    std::ostringstream err_stream;
+    EXPECT_TRUE(cli.ExecutePipelineIntoSink("generate 3 | grep 2", sink, err_stream).success);
+    EXPECT_EQ(sink.out, "2\n\n");
+    EXPECT_FALSE(cli.ExecutePipelineIntoSink("generate 3 | nothing", sink, err_stream).success);
+    EXPECT_FALSE(err_stream.str().empty());
+}
+
 int main(int argc, char **argv) {
     ::testing::InitGoogleTest(&argc, argv);
 